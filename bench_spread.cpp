@@ -0,0 +1,72 @@
+//Porownuje SpreadMode z ShuffleMode na playliscie miliona piosenek
+//z nierownym rozkladem wykonawcow: czas wyznaczenia kolejnosci i liczbe
+//sasiadujacych piosenek tego samego wykonawcy.
+//Kompilacja: g++ -std=c++17 -O2 -pthread bench_spread.cpp -o bench_spread
+#include "lib_playlist.h"
+#include <chrono>
+
+const size_t ITEMS = 1000000;
+const size_t ARTISTS = 500;
+const size_t SONGS_PER_ARTIST = 4;
+
+//liczba par sasiednich elementow z tym samym kluczem
+size_t adjacent_pairs(const std::vector<PlaylistInterface*>& items,
+                      const std::vector<size_t>& order) {
+    size_t pairs = 0;
+    for (size_t i = 1; i < order.size(); i++) {
+        SpreadKey before = items[order[i - 1]]->spread_key();
+        SpreadKey after = items[order[i]]->spread_key();
+        if (before.kind == after.kind && before.value == after.value) {
+            pairs++;
+        }
+    }
+    return pairs;
+}
+
+//mierzy jeden sposob odtwarzania i zwraca liczbe sasiednich par
+size_t measure(const char* label, Mode& mode,
+               const std::vector<PlaylistInterface*>& items) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<size_t> order = mode.order(items);
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+    size_t pairs = adjacent_pairs(items, order);
+    std::cout << label << ": " << elapsed.count() << " s, " << pairs
+              << " adjacent same-artist pairs" << std::endl;
+    return pairs;
+}
+
+int main() {
+    std::vector<std::shared_ptr<Play>> songs;
+    for (size_t artist = 0; artist < ARTISTS; artist++) {
+        for (size_t song = 0; song < SONGS_PER_ARTIST; song++) {
+            std::string descriptor = "audio|artist:Artist " +
+                                     std::to_string(artist) + "|title:Song " +
+                                     std::to_string(song) + "|la la la";
+            songs.push_back(Player::openFile(File(descriptor.c_str())));
+        }
+    }
+    //wykonawca k jest wybierany z waga 1/(k+1), wiec kilku wykonawcow
+    //ma duza czesc playlisty
+    std::vector<double> weights(ARTISTS);
+    for (size_t artist = 0; artist < ARTISTS; artist++) {
+        weights[artist] = 1.0 / static_cast<double>(artist + 1);
+    }
+    std::default_random_engine engine(2024);
+    std::discrete_distribution<size_t> pick_artist(weights.begin(),
+                                                   weights.end());
+    std::uniform_int_distribution<size_t> pick_song(0, SONGS_PER_ARTIST - 1);
+    std::vector<PlaylistInterface*> items;
+    items.reserve(ITEMS);
+    for (size_t i = 0; i < ITEMS; i++) {
+        size_t artist = pick_artist(engine);
+        items.push_back(songs[artist * SONGS_PER_ARTIST +
+                              pick_song(engine)].get());
+    }
+
+    ShuffleMode shuffle(42);
+    SpreadMode spread(42);
+    size_t shuffle_pairs = measure("ShuffleMode", shuffle, items);
+    size_t spread_pairs = measure("SpreadMode", spread, items);
+    return spread_pairs < shuffle_pairs ? 0 : 1;
+}
@@ -2,9 +2,33 @@
 #define JNP6_LIB_PLAYLIST_H
 #include <iostream>
 #include <unordered_map>
+#include <unordered_set>
 #include <regex>
 #include <list>
+#include <deque>
+#include <map>
 #include <random>
+#include <memory>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <shared_mutex>
+#include <exception>
+#include <atomic>
+#include <string_view>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <cstdio>
 
 //Korzen klas wyjatkow
 class PlayerException : public std::exception{
@@ -57,12 +81,160 @@ public:
         return "remove error";
     }
 };
+//wyjatek, gdy nie udala sie operacja na pliku
+class DiskError : public PlayerException {
+public:
+    const char* what() const noexcept override {
+        return "disk error";
+    }
+};
+//wyjatek, gdy pozycja lub permutacja pozycji jest niepoprawna
+class WrongPosition : public PlayerException {
+public:
+    const char* what() const noexcept override {
+        return "wrong position";
+    }
+};
+//wyjatek, gdy playlista nie moze odtwarzac w danym sposobie
+class WrongMode : public PlayerException {
+public:
+    const char* what() const noexcept override {
+        return "wrong mode";
+    }
+};
+//wyjatek, gdy zmiany nie da sie cofnac, bo usunieta podplaylista
+//juz nie istnieje
+class UndoError : public PlayerException {
+public:
+    const char* what() const noexcept override {
+        return "undo error";
+    }
+};
+//Podsumowanie tego, co odtwarza element: ile utworow kazdego rodzaju
+//(z powtorzeniami), ile naglowkow playlist i jak gleboko sa zagniezdzone
+struct PlayStats {
+    size_t songs;
+    size_t movies;
+    size_t others;
+    size_t playlists;
+    size_t depth;
+    size_t leaves() const {
+        return songs + movies + others;
+    }
+    bool operator==(const PlayStats& other) const {
+        return songs == other.songs && movies == other.movies &&
+               others == other.others && playlists == other.playlists &&
+               depth == other.depth;
+    }
+};
+//Zajetosc pamieci w bajtach, w podziale na rodzaje. Liczona dokladnie
+//z rozmiarow obiektow i pojemnosci kontenerow, bez narzutu alokatora;
+//wezly kontenerow i bloki kontrolne shared_ptr maja typowy uklad
+//z biblioteki standardowej
+struct MemoryFootprint {
+    //obiekty utworow
+    size_t items;
+    //tresc napisow, ktora nie miesci sie w samym obiekcie napisu
+    size_t strings;
+    //obiekty playlist
+    size_t playlists;
+    //listy elementow playlist
+    size_t lists;
+    //dowiazania do rodzicow, histogramy glebokosci i obserwatorzy
+    size_t links;
+    //historia zmian do cofniecia
+    size_t history;
+    //zapamietane plany odtwarzania
+    size_t plans;
+    //tablice i slowniki rejestrow oraz pamieci podrecznych
+    size_t indexes;
+    //strony playlist dyskowych trzymane w pamieci
+    size_t pages;
+    //czesc sumy zajmowana przez obiekty osiagalne z wielu miejsc; liczac
+    //kazde miejsce osobno, policzyloby sie je wielokrotnie
+    size_t shared;
+    static const size_t CONTROL_BLOCK = 2 * sizeof(void*);
+    size_t total() const {
+        return items + strings + playlists + lists + links + history +
+               plans + indexes + pages;
+    }
+    MemoryFootprint& operator+=(const MemoryFootprint& other);
+    static size_t string_bytes(const std::string& str);
+    //wezel std::list, std::unordered_map i std::map o wartosci value
+    static size_t list_node(size_t value) {
+        return 2 * sizeof(void*) + value;
+    }
+    static size_t hash_node(size_t value) {
+        return sizeof(void*) + value + sizeof(size_t);
+    }
+    static size_t tree_node(size_t value) {
+        return 4 * sizeof(void*) + value;
+    }
+    //std::deque o size elementach value: bloki po 512 bajtow (lub po
+    //jednym wiekszym elemencie) i tablica wskaznikow na bloki, ktora ma
+    //co najmniej 8 miejsc; pusta kolejka tez ma jeden blok
+    static size_t deque_bytes(size_t size, size_t value) {
+        size_t per_block = value < 512 ? 512 / value : 1;
+        size_t blocks = size / per_block + 1;
+        return blocks * per_block * value +
+               std::max<size_t>(8, blocks + 2) * sizeof(void*);
+    }
+};
+MemoryFootprint& MemoryFootprint::operator+=(const MemoryFootprint& other) {
+    items += other.items;
+    strings += other.strings;
+    playlists += other.playlists;
+    lists += other.lists;
+    links += other.links;
+    history += other.history;
+    plans += other.plans;
+    indexes += other.indexes;
+    pages += other.pages;
+    shared += other.shared;
+    return *this;
+}
+//pamiec napisu poza jego obiektem; krotkie napisy mieszcza sie w obiekcie
+size_t MemoryFootprint::string_bytes(const std::string& str) {
+    static const size_t inline_capacity = std::string().capacity();
+    return str.capacity() > inline_capacity ? str.capacity() + 1 : 0;
+}
+class Playlist;
+class PlaylistObserver;
+class ItemChunk;
+//klucz, wedlug ktorego SpreadMode rozrzuca podobne elementy: rodzaj
+//klucza i wartosc. Rodzaj oddziela np. wykonawce "1999" od filmow
+//z 1999 roku; NONE oznacza, ze element nie ma z czym byc rozrzucany
+struct SpreadKey {
+    enum Kind : uint8_t { NONE, ARTIST, YEAR, KINDS };
+    Kind kind;
+    std::string_view value;
+};
 //Abstrakcyjna klasa playlisty
 class PlaylistInterface {
 public:
     virtual void play() = 0;
     virtual bool is_collision(PlaylistInterface* obj) = 0;
     virtual bool can_cause_collision() = 0;
+    virtual PlayStats stats() = 0;
+    //zapisuje/usuwa dowiazanie do kawalka listy playlisty, ktory zawiera
+    //ten element; zwraca false, gdy element nie sledzi swoich rodzicow,
+    //bo sie nie zmienia
+    virtual bool attach_parent(ItemChunk* parent) {
+        (void)parent;
+        return false;
+    }
+    virtual bool detach_parent(ItemChunk* parent) {
+        (void)parent;
+        return false;
+    }
+    //klucz, wedlug ktorego SpreadMode rozrzuca podobne elementy
+    virtual SpreadKey spread_key() {
+        return {SpreadKey::NONE, {}};
+    }
+    //dolicza pamiec samego elementu, bez elementow, ktore zawiera
+    virtual void measure(MemoryFootprint& footprint) {
+        (void)footprint;
+    }
 
     virtual ~PlaylistInterface() = default;
 };
@@ -71,13 +243,76 @@ class Mode {
 public:
     virtual void play_with_mode
                 (std::list<std::shared_ptr<PlaylistInterface>>& list) = 0;
+    //zwraca pozycje elementow w kolejnosci, w jakiej zostana odtworzone.
+    //Domyslnie wyznacza je z play_with_mode, wiec sposob odtwarzania
+    //napisany tylko z play_with_mode dziala tak jak wczesniej
+    virtual std::vector<size_t> order
+                (const std::vector<PlaylistInterface*>& items);
+    //czy order jest napisane wprost; jesli nie, play() przekazuje
+    //play_with_mode prawdziwe elementy zamiast zastepnikow
+    virtual bool overrides_order() const {
+        return false;
+    }
+    //podaje po kolei pozycje count elementow bez dostepu do samych
+    //elementow; zwraca false, gdy kolejnosc zalezy od elementow
+    virtual bool visit_positions(size_t count,
+                                 const std::function<void(size_t)>& visit) {
+        (void)count;
+        (void)visit;
+        return false;
+    }
     virtual ~Mode() = default;
 };
+//odtwarza przez play_with_mode zastepniki elementow, ktore zapisuja
+//swoje pozycje zamiast cokolwiek wypisywac. Zastepnik przekazuje dalej
+//stats, spread_key i can_cause_collision, ale nie jest typu elementu,
+//ktory zastepuje, wiec play() ich nie uzywa, a uzywa ich compile
+std::vector<size_t> Mode::order(const std::vector<PlaylistInterface*>& items) {
+    class Stand : public PlaylistInterface {
+    private:
+        PlaylistInterface* item;
+        size_t position;
+        std::vector<size_t>& played;
+    public:
+        Stand(PlaylistInterface* pi, size_t at, std::vector<size_t>& out)
+                : item(pi), position(at), played(out) {}
+        void play() override {
+            played.push_back(position);
+        }
+        bool is_collision(PlaylistInterface* obj) override {
+            return item->is_collision(obj);
+        }
+        bool can_cause_collision() override {
+            return item->can_cause_collision();
+        }
+        PlayStats stats() override {
+            return item->stats();
+        }
+        SpreadKey spread_key() override {
+            return item->spread_key();
+        }
+    };
+    std::vector<size_t> positions;
+    positions.reserve(items.size());
+    std::list<std::shared_ptr<PlaylistInterface>> stands;
+    for (size_t i = 0; i < items.size(); i++) {
+        stands.push_back(std::make_shared<Stand>(items[i], i, positions));
+    }
+    play_with_mode(stands);
+    return positions;
+}
 //sekwencyjny sposob odtwarzania
 class SequenceMode : public Mode {
 public:
     void play_with_mode
         (std::list<std::shared_ptr<PlaylistInterface>>& list) override;
+    std::vector<size_t> order
+        (const std::vector<PlaylistInterface*>& items) override;
+    bool overrides_order() const override {
+        return true;
+    }
+    bool visit_positions(size_t count,
+                         const std::function<void(size_t)>& visit) override;
 };
 //metoda, ktora odtwarza playliste w kolejnosci sekwencyjnej
 void SequenceMode::play_with_mode
@@ -87,11 +322,32 @@ void SequenceMode::play_with_mode
         (*it)->play();
     }
 }
+//kolejnosc sekwencyjna
+std::vector<size_t> SequenceMode::order
+                (const std::vector<PlaylistInterface*>& items) {
+    std::vector<size_t> positions(items.size());
+    std::iota(positions.begin(), positions.end(), 0);
+    return positions;
+}
+bool SequenceMode::visit_positions(size_t count,
+                                   const std::function<void(size_t)>& visit) {
+    for (size_t i = 0; i < count; i++) {
+        visit(i);
+    }
+    return true;
+}
 //sposob odtwarzania nieparzyste/parzyste
 class OddEvenMode : public Mode {
 public:
     void play_with_mode
         (std::list<std::shared_ptr<PlaylistInterface>>& list) override;
+    std::vector<size_t> order
+        (const std::vector<PlaylistInterface*>& items) override;
+    bool overrides_order() const override {
+        return true;
+    }
+    bool visit_positions(size_t count,
+                         const std::function<void(size_t)>& visit) override;
 };
 //metoda, ktora odtwarza co druga piosenke
 void play_every_two(std::list<std::shared_ptr<PlaylistInterface>>::iterator& it,
@@ -114,6 +370,29 @@ void OddEvenMode::play_with_mode
     it = list.begin();
     play_every_two(it, list);
 }
+//kolejnosc nieparzyste/parzyste
+std::vector<size_t> OddEvenMode::order
+                (const std::vector<PlaylistInterface*>& items) {
+    std::vector<size_t> positions;
+    positions.reserve(items.size());
+    for (size_t i = 1; i < items.size(); i += 2) {
+        positions.push_back(i);
+    }
+    for (size_t i = 0; i < items.size(); i += 2) {
+        positions.push_back(i);
+    }
+    return positions;
+}
+bool OddEvenMode::visit_positions(size_t count,
+                                  const std::function<void(size_t)>& visit) {
+    for (size_t i = 1; i < count; i += 2) {
+        visit(i);
+    }
+    for (size_t i = 0; i < count; i += 2) {
+        visit(i);
+    }
+    return true;
+}
 //sposob odtwarzania losowy
 class ShuffleMode : public Mode {
 private:
@@ -122,8 +401,18 @@ public:
     ShuffleMode(size_t new_seed) {
         seed = new_seed;
     }
+    size_t get_seed() const {
+        return seed;
+    }
     void play_with_mode
         (std::list<std::shared_ptr<PlaylistInterface>>& list) override;
+    std::vector<size_t> order
+        (const std::vector<PlaylistInterface*>& items) override;
+    bool overrides_order() const override {
+        return true;
+    }
+    bool visit_positions(size_t count,
+                         const std::function<void(size_t)>& visit) override;
 };
 //metoda, ktora odtwarza w kolejnosci losowej
 void ShuffleMode::play_with_mode
@@ -140,6 +429,118 @@ void ShuffleMode::play_with_mode
         (*it)->play();
     }
 }
+//kolejnosc losowa, ta sama co w play_with_mode dla tego samego ziarna
+std::vector<size_t> ShuffleMode::order
+                (const std::vector<PlaylistInterface*>& items) {
+    std::vector<size_t> positions(items.size());
+    std::iota(positions.begin(), positions.end(), 0);
+    std::shuffle(positions.begin(), positions.end(),
+                 std::default_random_engine(seed));
+    return positions;
+}
+//ta sama permutacja co w order, ale na 4-bajtowych pozycjach,
+//o ile wszystkie sie w nich mieszcza
+bool ShuffleMode::visit_positions(size_t count,
+                                  const std::function<void(size_t)>& visit) {
+    if (count > UINT32_MAX) {
+        return false;
+    }
+    std::vector<uint32_t> positions(count);
+    std::iota(positions.begin(), positions.end(), 0);
+    std::shuffle(positions.begin(), positions.end(),
+                 std::default_random_engine(seed));
+    for (uint32_t position : positions) {
+        visit(position);
+    }
+    return true;
+}
+//sposob odtwarzania losowy, ale rozrzucajacy po calej playliscie
+//piosenki tego samego wykonawcy i filmy z tego samego roku
+class SpreadMode : public Mode {
+private:
+    size_t seed;
+public:
+    SpreadMode(size_t new_seed) {
+        seed = new_seed;
+    }
+    size_t get_seed() const {
+        return seed;
+    }
+    void play_with_mode
+        (std::list<std::shared_ptr<PlaylistInterface>>& list) override;
+    std::vector<size_t> order
+        (const std::vector<PlaylistInterface*>& items) override;
+    bool overrides_order() const override {
+        return true;
+    }
+};
+//metoda, ktora odtwarza w kolejnosci rozrzuconej
+void SpreadMode::play_with_mode
+                (std::list<std::shared_ptr<PlaylistInterface>>& list) {
+    std::vector<PlaylistInterface*> items;
+    items.reserve(list.size());
+    for (auto& pi : list) {
+        items.push_back(pi.get());
+    }
+    for (size_t position : order(items)) {
+        items[position]->play();
+    }
+}
+//Kolejnosc rozrzucona w czasie O(n log n). Elementy sa dzielone na grupy
+//wedlug klucza; k elementow grupy, w losowej kolejnosci, dostaje miejsca
+//(i + przesuniecie + drgania) / k dla i = 0..k-1, z przesunieciem
+//losowanym raz na grupe, a drganiami osobno dla kazdego elementu.
+//Elementy bez klucza sa grupami jednoelementowymi. Na koniec wszystkie
+//elementy sa sortowane wedlug miejsc
+std::vector<size_t> SpreadMode::order
+                (const std::vector<PlaylistInterface*>& items) {
+    std::default_random_engine engine(seed);
+    auto uniform = [&engine]() {
+        return static_cast<double>(engine() - engine.min()) /
+               (static_cast<double>(engine.max() - engine.min()) + 1.0);
+    };
+    //grupy w kolejnosci pierwszego wystapienia, zeby wynik zalezal
+    //tylko od ziarna i elementow; osobno dla kazdego rodzaju klucza
+    std::unordered_map<std::string_view, size_t> group_of[SpreadKey::KINDS];
+    std::vector<std::vector<size_t>> groups;
+    std::vector<size_t> loose;
+    for (size_t i = 0; i < items.size(); i++) {
+        SpreadKey key = items[i]->spread_key();
+        if (key.kind == SpreadKey::NONE || key.value.empty()) {
+            loose.push_back(i);
+            continue;
+        }
+        auto it = group_of[key.kind].try_emplace(key.value, groups.size()).first;
+        if (it->second == groups.size()) {
+            groups.emplace_back();
+        }
+        groups[it->second].push_back(i);
+    }
+    std::vector<std::pair<double, size_t>> placed;
+    placed.reserve(items.size());
+    for (auto& group : groups) {
+        std::shuffle(group.begin(), group.end(), engine);
+        double size = static_cast<double>(group.size());
+        double offset = uniform();
+        for (size_t i = 0; i < group.size(); i++) {
+            //drgania do 0.2 odstepu, wiec sasiedzi z grupy dziela
+            //co najmniej 0.6 odstepu
+            double jitter = (uniform() - 0.5) * 0.4;
+            double spot = (static_cast<double>(i) + offset + jitter) / size;
+            placed.push_back({spot, group[i]});
+        }
+    }
+    for (size_t i : loose) {
+        placed.push_back({uniform(), i});
+    }
+    std::sort(placed.begin(), placed.end());
+    std::vector<size_t> positions;
+    positions.reserve(items.size());
+    for (auto& spot : placed) {
+        positions.push_back(spot.second);
+    }
+    return positions;
+}
 //metoda, ktora zwraca klase reprezentujaca sekwencyjna
 //kolejnosc odtwarzania
 std::shared_ptr<SequenceMode> createSequenceMode() {
@@ -155,326 +556,4109 @@ std::shared_ptr<OddEvenMode> createOddEvenMode() {
 std::shared_ptr<ShuffleMode> createShuffleMode(size_t seed) {
     return std::make_shared<ShuffleMode>(seed);
 }
+//metoda, ktora zwraca klase reprezentujaca losowa kolejnosc
+//odtwarzania, rozrzucajaca elementy o tym samym kluczu
+std::shared_ptr<SpreadMode> createSpreadMode(size_t seed) {
+    return std::make_shared<SpreadMode>(seed);
+}
+//Skompilowany plan odtwarzania playlisty: liniowa tablica krokow
+//w ostatecznej kolejnosci. Plan trzyma listy elementow wszystkich
+//splaszczonych playlist, wiec pozostaje poprawny takze po ich zmianie
+class PlayPlan {
+public:
+    //krok planu: naglowek playlisty (item == nullptr) albo element
+    struct Step {
+        const char* playlist_name;
+        PlaylistInterface* item;
+    };
+private:
+    std::vector<Step> steps;
+    std::vector<std::shared_ptr<const void>> snapshots;
+    friend class Playlist;
+public:
+    size_t size() const {
+        return steps.size();
+    }
+    const std::vector<Step>& get_steps() const {
+        return steps;
+    }
+    void play() const;
+};
+//odtwarza plan w jednej petli, bez przechodzenia po drzewie playlist
+void PlayPlan::play() const {
+    for (const Step& step : steps) {
+        if (step.item == nullptr) {
+            std::cout<<"Playlist ["<<step.playlist_name<<"]"<<std::endl;
+        } else {
+            step.item->play();
+        }
+    }
+}
+//Kawalek listy elementow playlisty. Lista jest ciagiem kawalkow, ktore
+//klon wspoldzieli z oryginalem; kawalek jest zmieniany w miejscu tylko
+//wtedy, gdy trzyma go jedna playlista i zaden plan, wiec pierwsza zmiana
+//klonu kopiuje jeden kawalek, a nie cala liste. Elementy, ktore sledza
+//swoich rodzicow, maja dowiazanie do kawalka, a kawalek zna playlisty,
+//ktore go zawieraja
+class ItemChunk {
+private:
+    std::vector<std::shared_ptr<PlaylistInterface>> items;
+    //playlisty, ktorych lista zawiera ten kawalek; zbior, bo kawalek
+    //moze byc wspoldzielony przez bardzo wiele klonow, a kazdy klon
+    //wypisuje sie z niego przy pierwszej zmianie i przy usunieciu
+    std::unordered_set<Playlist*> owners;
+    //liczba elementow, ktore maja dowiazanie do tego kawalka
+    size_t linked;
+    friend class Playlist;
+public:
+    ItemChunk() {
+        linked = 0;
+    }
+    const std::unordered_set<Playlist*>& get_owners() const {
+        return owners;
+    }
+};
 //klasa Playlisty reprezentowanej, jako liste klas PlaylistInterface
 class Playlist : public PlaylistInterface {
+public:
+    //lista elementow jako ciag niepustych kawalkow
+    class Items {
+    private:
+        std::vector<std::shared_ptr<ItemChunk>> chunks;
+        //ends[i] to liczba elementow w kawalkach od 0 do i
+        std::vector<size_t> ends;
+        friend class Playlist;
+    public:
+        class const_iterator {
+        private:
+            const std::vector<std::shared_ptr<ItemChunk>>* chunks;
+            size_t chunk;
+            size_t offset;
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = std::shared_ptr<PlaylistInterface>;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const value_type*;
+            using reference = const value_type&;
+            const_iterator(const std::vector<std::shared_ptr<ItemChunk>>* all,
+                           size_t at_chunk, size_t at_offset) {
+                chunks = all;
+                chunk = at_chunk;
+                offset = at_offset;
+            }
+            reference operator*() const {
+                return (*chunks)[chunk]->items[offset];
+            }
+            pointer operator->() const {
+                return &**this;
+            }
+            const_iterator& operator++() {
+                if (++offset == (*chunks)[chunk]->items.size()) {
+                    chunk++;
+                    offset = 0;
+                }
+                return *this;
+            }
+            const_iterator operator++(int) {
+                const_iterator old = *this;
+                ++*this;
+                return old;
+            }
+            bool operator==(const const_iterator& other) const {
+                return chunk == other.chunk && offset == other.offset;
+            }
+            bool operator!=(const const_iterator& other) const {
+                return !(*this == other);
+            }
+        };
+        size_t size() const {
+            return ends.empty() ? 0 : ends.back();
+        }
+        bool empty() const {
+            return ends.empty();
+        }
+        const_iterator begin() const {
+            return {&chunks, 0, 0};
+        }
+        const_iterator end() const {
+            return {&chunks, chunks.size(), 0};
+        }
+        const_iterator at(size_t position) const;
+        size_t locate(size_t position, size_t& offset) const;
+    };
 private:
-    std::list<std::shared_ptr<PlaylistInterface>> list_to_play;
+    //docelowa liczba elementow kawalka; kawalek jest dzielony, gdy ma
+    //ich ponad dwa razy wiecej, i laczony z sasiadem, gdy ma ich malo
+    static const size_t CHUNK_ITEMS = 256;
+    //zapis pojedynczej zmiany, wystarczajacy do jej cofniecia
+    struct Edit {
+        enum Kind { INSERTED, ERASED, MOVED, REORDERED, MODE_CHANGED };
+        Kind kind;
+        size_t position;
+        size_t count;
+        size_t target;
+        std::vector<std::shared_ptr<PlaylistInterface>> items;
+        std::vector<size_t> permutation;
+        std::shared_ptr<Mode> mode;
+        //usuniete podplaylisty, po kolei; w items na ich miejscu jest
+        //nullptr. Historia trzyma je slabo, bo dwie playlisty, ktore
+        //usunely siebie nawzajem, inaczej nigdy by nie zostaly zwolnione
+        std::vector<std::weak_ptr<PlaylistInterface>> playlists {};
+    };
+    //elementy playlisty; kawalki sa wspoldzielone z klonami i planami
+    Items list_to_play;
     //nazwa playlisty
     const char* name;
     //sposob odtwarzania
     std::shared_ptr<Mode> mode;
+    //kawalki list, ktore zawieraja te playliste (po jednym wpisie
+    //na kazde wystapienie)
+    std::vector<ItemChunk*> parents;
+    //podsumowanie calego poddrzewa, aktualizowane przy kazdej zmianie
+    PlayStats totals;
+    //ile elementow listy ma dana glebokosc
+    std::map<size_t, size_t> child_depths;
+    //zapamietany plan odtwarzania, pusty gdy trzeba go przeliczyc
+    std::shared_ptr<const PlayPlan> plan;
+    //zapamietana liczba roznych utworow
+    size_t distinct_leaves;
+    bool distinct_known;
+    //czy ta playlista lub ktoras z zawierajacych ja zapamietala
+    //cos, co zalezy od jej zawartosci
+    bool derived;
+    //ostatnie zmiany, najwyzej history_limit, do cofniecia przez undo
+    std::deque<Edit> history;
+    size_t history_limit;
+    //numer wersji, zwiekszany przy kazdej zmianie
+    size_t version;
+    //obserwatorzy powiadamiani o kazdej zmianie
+    std::vector<PlaylistObserver*> observers;
+    //krok przejscia w gore: playlista, jej kawalek-rodzic i wlasciciel
+    //tego kawalka
+    struct WalkStep {
+        Playlist* playlist;
+        size_t chunk;
+        std::unordered_set<Playlist*>::const_iterator owner;
+    };
+    //kontenery pomocnicze propagate, wspolne dla watku, zeby zmiana
+    //w hierarchii z wieloma rodzicami nie alokowala ich za kazdym razem
+    struct Walk {
+        std::vector<Playlist*> order;
+        std::unordered_set<Playlist*> visited;
+        std::vector<WalkStep> path;
+        std::unordered_map<Playlist*, PlayStats> before;
+    };
+    static Walk& walk_scratch();
+    static Playlist* as_playlist(PlaylistInterface* pi);
+    static void link_item(ItemChunk& chunk, PlaylistInterface* pi);
+    static void unlink_item(ItemChunk& chunk, PlaylistInterface* pi);
+    void adopt(ItemChunk& chunk);
+    void abandon(ItemChunk& chunk);
+    void account(PlaylistInterface* pi, bool added);
+    Playlist* only_parent() const;
+    void replace_child(const PlayStats& before, const PlayStats& after);
+    void propagate(const PlayStats& old_totals);
+    void propagate_shared(const PlayStats& old_totals);
+    void child_changed(const PlayStats& before, const PlayStats& after);
+    friend class DiskPlaylist;
+    friend class CatalogBuilder;
+    friend class ChangeRecords;
+    void invalidate();
+    bool contained_in(const std::vector<PlaylistInterface*>& roots);
+    bool has_ancestor(Playlist* target);
+    void release_children
+            (std::vector<std::shared_ptr<PlaylistInterface>>& released);
+    void traverse(Mode& top_mode,
+                  const std::function<void(Playlist*, PlaylistInterface*)>&
+                  visit, bool enter_all);
+    const std::shared_ptr<PlaylistInterface>& item_at(size_t position) const;
+    ItemChunk& writable_chunk(size_t index);
+    std::shared_ptr<ItemChunk> make_chunk
+            (std::vector<std::shared_ptr<PlaylistInterface>>::iterator first,
+             std::vector<std::shared_ptr<PlaylistInterface>>::iterator last);
+    void split_chunk(size_t index, size_t at);
+    void merge_chunks(size_t index);
+    void recount(size_t index);
+    void place_item(size_t position,
+                    const std::shared_ptr<PlaylistInterface>& pi);
+    void place_items(size_t position,
+                     std::vector<std::shared_ptr<PlaylistInterface>>& new_items);
+    std::vector<std::shared_ptr<PlaylistInterface>> take_items(size_t first,
+                                                               size_t last);
+    void insert_item(size_t position,
+                     const std::shared_ptr<PlaylistInterface>& pi);
+    void insert_items(size_t position,
+                      std::vector<std::shared_ptr<PlaylistInterface>>& new_items);
+    std::vector<std::shared_ptr<PlaylistInterface>> erase_items(size_t first,
+                                                                size_t last);
+    void move_items(size_t first, size_t count, size_t position);
+    void permute_items(const std::vector<size_t>& permutation);
+    void record(Edit&& edit);
+    template <typename Call>
+    void notify(const Call& call);
+    void notify_inserted(size_t position, size_t count);
+    void notify_erased(size_t first, size_t last);
+    void notify_moved(size_t first, size_t count, size_t position);
+    void notify_reordered(const std::vector<size_t>& permutation);
+    void notify_mode_changed();
+    void notify_undone(const Edit& edit);
+    std::shared_ptr<const PlayPlan> build_plan(Mode& top_mode);
 public:
     Playlist(const char* myname) {
-        list_to_play = std::list<std::shared_ptr<PlaylistInterface>>();
         name = myname;
         std::shared_ptr<SequenceMode> sm = std::make_shared<SequenceMode>();
         mode = sm;
+        totals = {0, 0, 0, 1, 1};
+        distinct_leaves = 0;
+        distinct_known = false;
+        derived = false;
+        history_limit = 0;
+        version = 0;
     }
+    Playlist(const Playlist&) = delete;
+    Playlist& operator=(const Playlist&) = delete;
+    ~Playlist() override;
     void add(const std::shared_ptr<PlaylistInterface>& pi);
     void add(const std::shared_ptr<PlaylistInterface>& pi, size_t position);
     void remove();
     void remove(size_t position);
+    void add(const std::vector<std::shared_ptr<PlaylistInterface>>& items,
+             size_t position);
+    void remove(size_t first, size_t last);
+    void splice(size_t position, Playlist& other, size_t first, size_t last);
+    void reorder(const std::vector<size_t>& permutation);
     void setMode(std::shared_ptr<Mode> mode);
+    std::shared_ptr<Playlist> clone();
+    std::shared_ptr<Playlist> clone(const char* new_name);
+    void setHistoryLimit(size_t limit);
+    bool undo();
+    size_t getVersion() const {
+        return version;
+    }
+    const char* getName() const {
+        return name;
+    }
+    void addObserver(PlaylistObserver* observer);
+    void removeObserver(PlaylistObserver* observer);
+    std::shared_ptr<const PlayPlan> compile();
+    std::shared_ptr<const PlayPlan> compile(Mode& top_mode);
+    PlayStats stats() override;
+    bool attach_parent(ItemChunk* parent) override;
+    bool detach_parent(ItemChunk* parent) override;
+    void measure(MemoryFootprint& footprint) override;
+    MemoryFootprint footprint();
+    size_t distinct_items();
     bool is_collision(PlaylistInterface* obj) override;
     bool can_cause_collision() override;
     void play() override;
 };
-//dodaje nowy element do playlisty
-void Playlist::add(const std::shared_ptr<PlaylistInterface>& pi) {
-    if (pi->is_collision(this)) {
-        throw NoCyclesAllowed();
+//Obserwator zmian playlisty. Jest powiadamiany po kazdej udanej zmianie,
+//takze po jej cofnieciu przez undo, juz o samej operacji na liscie:
+//przeniesienie miedzy playlistami to usuniecie z jednej i wstawienie
+//do drugiej. Obserwator musi sie wypisac, zanim zostanie usuniety.
+//Wyjatek obserwatora wychodzi z metody playlisty, ale dopiero po
+//powiadomieniu pozostalych; zmiana zostaje wtedy w playliscie
+class PlaylistObserver {
+public:
+    virtual ~PlaylistObserver() = default;
+    //wstawiono count elementow od pozycji position, pierwszy to first
+    virtual void inserted(Playlist& playlist, size_t position,
+                          Playlist::Items::const_iterator first,
+                          size_t count) = 0;
+    //usunieto elementy z pozycji [first, last)
+    virtual void erased(Playlist& playlist, size_t first, size_t last) = 0;
+    //przeniesiono count elementow z pozycji first na pozycje position
+    virtual void moved(Playlist& playlist, size_t first, size_t count,
+                       size_t position) = 0;
+    //na pozycji i jest teraz element z pozycji permutation[i]
+    virtual void reordered(Playlist& playlist,
+                           const std::vector<size_t>& permutation) = 0;
+    //zmieniono sposob odtwarzania
+    virtual void mode_changed(Playlist& playlist,
+                              const std::shared_ptr<Mode>& mode) = 0;
+};
+//zwraca iterator na dana pozycje
+Playlist::Items::const_iterator Playlist::Items::at(size_t position) const {
+    if (position >= size()) {
+        return end();
     }
-    list_to_play.push_back(pi);
+    size_t offset;
+    size_t chunk = locate(position, offset);
+    return {&chunks, chunk, offset};
 }
-//dodaje nowy element, na konkretna pozycje w liscie
-void Playlist::add
-        (const std::shared_ptr<PlaylistInterface>& pi, size_t position) {
-    if (pi->is_collision(this)) {
-        throw NoCyclesAllowed();
-    }
-    auto it = list_to_play.begin();
-    std::advance(it, position);
-    list_to_play.insert(it, pi);
+//zwraca kawalek, w ktorym jest pozycja (mniejsza od size()),
+//i pozycje w tym kawalku
+size_t Playlist::Items::locate(size_t position, size_t& offset) const {
+    size_t chunk = static_cast<size_t>(
+            std::upper_bound(ends.begin(), ends.end(), position) - ends.begin());
+    offset = position - (chunk == 0 ? 0 : ends[chunk - 1]);
+    return chunk;
 }
-//usuwa ostatni element
-void Playlist::remove() {
-    if (!list_to_play.empty()) {
-        list_to_play.pop_back();
+//dolicza obiekt playlisty, tablice jej kawalkow i jej dowiazania
+void Playlist::measure(MemoryFootprint& footprint) {
+    footprint.playlists += sizeof(Playlist) + MemoryFootprint::CONTROL_BLOCK;
+    footprint.lists += list_to_play.chunks.capacity() *
+                       sizeof(std::shared_ptr<ItemChunk>) +
+                       list_to_play.ends.capacity() * sizeof(size_t);
+    footprint.links += parents.capacity() * sizeof(ItemChunk*) +
+                       observers.capacity() * sizeof(PlaylistObserver*) +
+                       child_depths.size() * MemoryFootprint::tree_node
+                               (sizeof(std::pair<const size_t, size_t>));
+}
+//podaje pamiec calej hierarchii tej playlisty. Kazdy obiekt jest
+//liczony raz, takze podplaylista zawarta w wielu playlistach i kawalek
+//wspoldzielony z klonem; liczone sa tez elementy trzymane juz tylko
+//przez historie zmian lub zapamietane plany
+MemoryFootprint Playlist::footprint() {
+    MemoryFootprint footprint {};
+    //rozmiar kazdego policzonego obiektu i czy byl osiagalny wiele razy
+    std::unordered_map<const void*, std::pair<size_t, bool>> counted;
+    std::vector<Playlist*> to_visit;
+    auto reach = [&counted](const void* object) {
+        auto result = counted.try_emplace(object, 0, false);
+        if (!result.second) {
+            result.first->second.second = true;
+        }
+        return result.second;
+    };
+    auto visit_element = [&](PlaylistInterface* pi) {
+        if (!reach(pi)) {
+            return;
+        }
+        Playlist* pl = as_playlist(pi);
+        if (pl != nullptr) {
+            to_visit.push_back(pl);
+            return;
+        }
+        size_t before = footprint.total();
+        pi->measure(footprint);
+        counted[pi].first = footprint.total() - before;
+    };
+    auto visit_chunks = [&](const Items& items, size_t& category) {
+        for (auto& chunk : items.chunks) {
+            if (!reach(chunk.get())) {
+                continue;
+            }
+            size_t bytes = sizeof(ItemChunk) + MemoryFootprint::CONTROL_BLOCK +
+                           chunk->items.capacity() *
+                           sizeof(std::shared_ptr<PlaylistInterface>) +
+                           chunk->owners.bucket_count() * sizeof(void*) +
+                           chunk->owners.size() *
+                           MemoryFootprint::hash_node(sizeof(Playlist*));
+            category += bytes;
+            counted[chunk.get()].first = bytes;
+            for (auto& pi : chunk->items) {
+                visit_element(pi.get());
+            }
+        }
+    };
+    //najpierw wszystko, co osiagalne z list elementow i historii, potem
+    //plany, zeby do planow trafily tylko kawalki trzymane juz tylko przez nie
+    std::vector<Playlist*> walked;
+    auto walk = [&]() {
+        while (!to_visit.empty()) {
+            Playlist* pl = to_visit.back();
+            to_visit.pop_back();
+            walked.push_back(pl);
+            size_t before = footprint.total();
+            pl->measure(footprint);
+            footprint.history += MemoryFootprint::deque_bytes
+                    (pl->history.size(), sizeof(Edit));
+            for (const Edit& edit : pl->history) {
+                footprint.history += edit.items.capacity() *
+                                     sizeof(std::shared_ptr<PlaylistInterface>) +
+                                     edit.playlists.capacity() *
+                                     sizeof(std::weak_ptr<PlaylistInterface>) +
+                                     edit.permutation.capacity() *
+                                     sizeof(size_t);
+            }
+            counted[static_cast<PlaylistInterface*>(pl)].first =
+                    footprint.total() - before;
+            visit_chunks(pl->list_to_play, footprint.lists);
+            for (const Edit& edit : pl->history) {
+                for (auto& pi : edit.items) {
+                    if (pi != nullptr) {
+                        visit_element(pi.get());
+                    }
+                }
+            }
+        }
+    };
+    reach(static_cast<PlaylistInterface*>(this));
+    to_visit.push_back(this);
+    walk();
+    for (size_t i = 0; i < walked.size(); i++) {
+        Playlist* pl = walked[i];
+        if (!pl->plan || !reach(pl->plan.get())) {
+            continue;
+        }
+        const PlayPlan& cached = *pl->plan;
+        size_t bytes = sizeof(PlayPlan) + MemoryFootprint::CONTROL_BLOCK +
+                       cached.steps.capacity() * sizeof(PlayPlan::Step) +
+                       cached.snapshots.capacity() *
+                       sizeof(std::shared_ptr<const void>);
+        for (auto& snapshot : cached.snapshots) {
+            auto items = static_cast<const Items*>(snapshot.get());
+            bytes += sizeof(Items) + MemoryFootprint::CONTROL_BLOCK +
+                     items->chunks.capacity() *
+                     sizeof(std::shared_ptr<ItemChunk>) +
+                     items->ends.capacity() * sizeof(size_t);
+        }
+        footprint.plans += bytes;
+        counted[pl->plan.get()].first = bytes;
+        for (auto& snapshot : cached.snapshots) {
+            visit_chunks(*static_cast<const Items*>(snapshot.get()),
+                         footprint.plans);
+        }
+        walk();
     }
-    else {
-        throw RemoveError();
+    for (auto& object : counted) {
+        if (object.second.second) {
+            footprint.shared += object.second.first;
+        }
     }
+    return footprint;
 }
-//usuwa element z okreslonej pozycji
-//lub rzuca wyjatek, gdy pozycja jest niepoprawna
-void Playlist::remove(size_t position) {
-    size_t list_size = list_to_play.size();
-    bool var1 = (position == 0 && list_size == 0);
-    bool var2 = (position > 0 && list_size <= position);
-    if (var1 || var2) {
-        throw RemoveError();
+//zwraca playliste, gdy element nia jest, w przeciwnym razie nullptr
+Playlist* Playlist::as_playlist(PlaylistInterface* pi) {
+    if (!pi->can_cause_collision()) {
+        return nullptr;
     }
-    auto it = list_to_play.begin();
-    std::advance(it, position);
-    list_to_play.erase(it);
+    return dynamic_cast<Playlist*>(pi);
 }
-//ustawia nowa metode odtwarzania
-void Playlist::setMode(std::shared_ptr<Mode> new_mode) {
-    mode = std::move(new_mode);
+//zapisuje u elementu, ze kawalek go zawiera
+void Playlist::link_item(ItemChunk& chunk, PlaylistInterface* pi) {
+    if (pi->attach_parent(&chunk)) {
+        chunk.linked++;
+    }
 }
-//odtwarza, wedlug ustawionego sposobu
-void Playlist::play() {
-    std::cout<<"Playlist ["<<name<<"]"<<std::endl;
-    mode->play_with_mode(list_to_play);
+//usuwa z elementu jedno dowiazanie do kawalka
+void Playlist::unlink_item(ItemChunk& chunk, PlaylistInterface* pi) {
+    if (chunk.linked > 0 && pi->detach_parent(&chunk)) {
+        chunk.linked--;
+    }
 }
-//sprawdza czy playlisty nie tworza cykli
-bool Playlist::is_collision(PlaylistInterface* obj) {
-    if (obj == this) {
-        return true;
+//dopisuje te playliste do wlascicieli kawalka. Elementy sa dowiazane
+//do kawalka, dopoki ma on jakiegokolwiek wlasciciela, wiec klon
+//niczego nie dowiazuje
+void Playlist::adopt(ItemChunk& chunk) {
+    chunk.owners.insert(this);
+    if (chunk.owners.size() == 1) {
+        for (auto& pi : chunk.items) {
+            link_item(chunk, pi.get());
+        }
     }
-    auto it = list_to_play.begin();
-    while (it != list_to_play.end()) {
-        if ((*it)->can_cause_collision()) {
-            Playlist* pl = dynamic_cast<Playlist*>(it->get());
-            bool b1 = (this == obj);
-            bool b2 = pl->is_collision(obj);
-            if (b1|| b2) {
-                return true;
-            }
+}
+//wypisuje te playliste z wlascicieli kawalka; kawalek bez wlascicieli
+//(trzymany juz tylko przez plan) nie jest rodzicem swoich elementow
+void Playlist::abandon(ItemChunk& chunk) {
+    if (chunk.owners.erase(this) == 0) {
+        return;
+    }
+    if (chunk.owners.empty()) {
+        for (auto& pi : chunk.items) {
+            unlink_item(chunk, pi.get());
         }
-        it++;
     }
-    return false;
 }
-//metoda okreslajaca, czy dana klasa moze powodowac kolizje
-bool Playlist::can_cause_collision() {
+//podplaylista zapamietuje kazde wystapienie w kawalku listy
+bool Playlist::attach_parent(ItemChunk* parent) {
+    parents.push_back(parent);
     return true;
 }
-//abstarkcyjna klasa Play, do ktorej naleza
-// Song i Movie
-class Play : public PlaylistInterface {
-
-public:
-    Play() = default;
-    bool is_collision(PlaylistInterface* obj) override;
-    bool can_cause_collision() override;
-    void play() override = 0;
-};
-//Obiekty tej klasy nie moga powodowac kolizji w postaci cykli
-bool Play::is_collision(PlaylistInterface* obj) {
-    (void)obj;
-    return false;
-}
-//Obiekty tej klasy nie moga powodowac kolizji w postaci cykli
-bool Play::can_cause_collision() {
-    return false;
-}
-//Klasa reprezentujaca piosenke
-class Song : public Play {
-private:
-    std::string artist;
-    std::string title;
-    std::string lyrics;
-public:
-    Song(std::unordered_map<std::string, std::string>& data, 
-            std::string& lyrics_add);
-    void play() override;
-};
-//konstruktor klasy piosenka, ktory sprawdza 
-//czy wszytskie parametry sa podane poprawnie
-Song::Song(std::unordered_map<std::string, 
-        std::string>& data, std::string& lyrics_add) {
-    auto it = data.find("artist");
-    if (it == data.end()) {
-        throw NoNecessaryData();
-    } else {
-        artist = it->second;
+//usuwa jedno dowiazanie do zawierajacego kawalka
+bool Playlist::detach_parent(ItemChunk* parent) {
+    auto it = std::find(parents.begin(), parents.end(), parent);
+    if (it != parents.end()) {
+        parents.erase(it);
     }
-    it = data.find("title");
-    if (it == data.end()) {
-        throw NoNecessaryData();
+    return true;
+}
+//dolicza lub odlicza podsumowanie elementu listy
+void Playlist::account(PlaylistInterface* pi, bool added) {
+    PlayStats st = pi->stats();
+    if (added) {
+        totals.songs += st.songs;
+        totals.movies += st.movies;
+        totals.others += st.others;
+        totals.playlists += st.playlists;
+        child_depths[st.depth]++;
     } else {
-        title = it->second;
+        totals.songs -= st.songs;
+        totals.movies -= st.movies;
+        totals.others -= st.others;
+        totals.playlists -= st.playlists;
+        auto it = child_depths.find(st.depth);
+        if (--it->second == 0) {
+            child_depths.erase(it);
+        }
     }
-    lyrics = lyrics_add;
 }
-//metoda odtwarzajaca piosenke
-void Song::play() {
-    std::cout<<"Song ["<<artist<<" "<<title<<"]: "<<lyrics<<std::endl;
+//kontenery pomocnicze propagate dla biezacego watku
+Playlist::Walk& Playlist::walk_scratch() {
+    static thread_local Walk walk;
+    return walk;
 }
-//metoda sprawdza, czy podano poprawny format roku
-bool correct_year(std::string& year) {
-
-    for (char const &c : year) {
-        if (c < '0' || c > '9')
-            return false;
+//zwraca playliste, ktora zawiera te playliste, jesli jest dokladnie
+//jedno takie miejsce; w przeciwnym razie nullptr
+Playlist* Playlist::only_parent() const {
+    if (parents.size() != 1 || parents[0]->owners.size() != 1) {
+        return nullptr;
     }
-    return true;
+    return *parents[0]->owners.begin();
 }
-//Klasa reprezentujaca film
-class Movie : public Play {
-private:
-    std::string year;
-    std::string title;
-    std::string lyrics;
-    std::string unROT13(std::string &str);
-public:
-    Movie(std::unordered_map<std::string, std::string>& data, 
-            std::string& lyr);
-    void play() override;
-};
-//Konstruktor klasy Movie, ktory sprawdza czy wszytkie parametry 
-// zostaly podane poprawnie
-Movie::Movie(std::unordered_map<std::string, std::string>& data, 
-        std::string& lyr) {
-    auto it = data.find("year");
-    if (it == data.end()) {
-        throw NoNecessaryData();
-    } else {
-        std::string& new_year = it->second;
-        if (correct_year(new_year)) {
-            year = it->second;
-        } else {
-            throw WrongYear();
-        }
+//poprawia podsumowanie po zmianie podsumowania jednego elementu listy,
+//bez powiadamiania playlist, ktore zawieraja te playliste
+void Playlist::replace_child(const PlayStats& before, const PlayStats& after) {
+    totals.songs += after.songs - before.songs;
+    totals.movies += after.movies - before.movies;
+    totals.others += after.others - before.others;
+    totals.playlists += after.playlists - before.playlists;
+    if (before.depth == after.depth) {
+        return;
     }
-    it = data.find("title");
-    if (it == data.end()) {
-        throw NoNecessaryData();
-    } else {
-        title = it->second;
+    auto depth = child_depths.find(before.depth);
+    if (--depth->second == 0) {
+        child_depths.erase(depth);
     }
-    lyrics = unROT13(lyr);
+    child_depths[after.depth]++;
 }
-//Metoda, ktora deszyfruje ROT13
-std::string Movie::unROT13(std::string &str) {
-    for(auto& it : str) {
-        if(it >= 'A' && it <= 'M') it += 13;
-        else if(it >= 'N' && it <= 'Z') it -= 13;
-        else if(it >= 'a' && it <= 'm') it += 13;
-        else if(it >= 'n' && it <= 'z') it -= 13;
+//po zmianie podsumowania tej playlisty poprawia podsumowania wszystkich,
+//ktore ja zawieraja. Dopoki kazda playlista na drodze w gore jest
+//zawarta w dokladnie jednym miejscu, idzie po kolei, bez zadnych
+//kontenerow; dopiero playlista z wieloma rodzicami uruchamia pelne
+//przejscie w propagate_shared
+void Playlist::propagate(const PlayStats& old_totals) {
+    totals.depth = child_depths.empty() ? 1 : child_depths.rbegin()->first + 1;
+    if (totals == old_totals) {
+        return;
+    }
+    Playlist* pl = this;
+    PlayStats then = old_totals;
+    while (!pl->parents.empty()) {
+        Playlist* parent = pl->only_parent();
+        if (parent == nullptr) {
+            pl->propagate_shared(then);
+            return;
+        }
+        PlayStats parent_then = parent->totals;
+        parent->replace_child(then, pl->totals);
+        parent->totals.depth = parent->child_depths.rbegin()->first + 1;
+        if (parent->totals == parent_then) {
+            return;
+        }
+        pl = parent;
+        then = parent_then;
     }
-    return str;
+}
+//poprawia podsumowania wszystkich playlist, ktore zawieraja te
+//playliste (jej podsumowanie jest juz nowe). Kazda z nich jest
+//odwiedzana raz, po wszystkich swoich zmienionych podplaylistach,
+//i dostaje tylko roznice
+void Playlist::propagate_shared(const PlayStats& old_totals) {
+    auto enter = [](Playlist* pl) {
+        WalkStep step {pl, 0, {}};
+        if (!pl->parents.empty()) {
+            step.owner = pl->parents[0]->owners.begin();
+        }
+        return step;
+    };
+    Walk& walk = walk_scratch();
+    std::vector<Playlist*>& order = walk.order;
+    std::unordered_set<Playlist*>& visited = walk.visited;
+    std::vector<WalkStep>& path = walk.path;
+    std::unordered_map<Playlist*, PlayStats>& before = walk.before;
+    order.clear();
+    visited.clear();
+    path.clear();
+    before.clear();
+    visited.insert(this);
+    path.push_back(enter(this));
+    while (!path.empty()) {
+        WalkStep& step = path.back();
+        Playlist* pl = step.playlist;
+        if (step.chunk == pl->parents.size()) {
+            order.push_back(pl);
+            path.pop_back();
+            continue;
+        }
+        if (step.owner == pl->parents[step.chunk]->owners.end()) {
+            if (++step.chunk < pl->parents.size()) {
+                step.owner = pl->parents[step.chunk]->owners.begin();
+            }
+            continue;
+        }
+        Playlist* parent = *step.owner++;
+        if (visited.insert(parent).second) {
+            path.push_back(enter(parent));
+        }
+    }
+    before.emplace(this, old_totals);
+    for (auto it = order.rbegin(); it != order.rend(); it++) {
+        Playlist* pl = *it;
+        auto old_stats = before.find(pl);
+        if (old_stats == before.end()) {
+            continue;
+        }
+        PlayStats& now = pl->totals;
+        if (pl != this) {
+            now.depth = pl->child_depths.rbegin()->first + 1;
+        }
+        const PlayStats& then = old_stats->second;
+        if (now == then) {
+            continue;
+        }
+        for (ItemChunk* chunk : pl->parents) {
+            for (Playlist* parent : chunk->owners) {
+                before.emplace(parent, parent->totals);
+                parent->replace_child(then, now);
+            }
+        }
+    }
+}
+//poprawia podsumowanie po zmianie elementu, ktory sie sam zmienia
+//(jedno wywolanie na kazde wystapienie tego elementu na liscie)
+void Playlist::child_changed(const PlayStats& before, const PlayStats& after) {
+    PlayStats old_totals = totals;
+    replace_child(before, after);
+    propagate(old_totals);
+}
+//uniewaznia to, co zapamietala ta playlista i wszystkie, ktore ja
+//zawieraja. Zapamietanie czegos dla playlisty oznacza jej podplaylisty,
+//wiec mozna sie zatrzymac na playliscie, ktora nie jest oznaczona
+void Playlist::invalidate() {
+    if (!derived) {
+        return;
+    }
+    std::vector<Playlist*> to_visit {this};
+    while (!to_visit.empty()) {
+        Playlist* pl = to_visit.back();
+        to_visit.pop_back();
+        if (pl->derived) {
+            pl->derived = false;
+            pl->distinct_known = false;
+            pl->plan.reset();
+            for (ItemChunk* chunk : pl->parents) {
+                to_visit.insert(to_visit.end(),
+                                chunk->owners.begin(), chunk->owners.end());
+            }
+        }
+    }
+}
+//usuwa dowiazania do tej playlisty z jej podplaylist
+Playlist::~Playlist() {
+    std::vector<std::shared_ptr<PlaylistInterface>> released;
+    release_children(released);
+    while (!released.empty()) {
+        std::shared_ptr<PlaylistInterface> pi = std::move(released.back());
+        released.pop_back();
+        as_playlist(pi.get())->release_children(released);
+    }
+}
+//wypisuje te playliste z jej kawalkow i przekazuje podplaylisty, ktorych
+//nikt inny nie trzyma, do zwolnienia przez wywolujacego. Dzieki temu
+//usuniecie bardzo glebokiej hierarchii nie jest rekurencyjne
+void Playlist::release_children
+        (std::vector<std::shared_ptr<PlaylistInterface>>& released) {
+    for (auto& chunk : list_to_play.chunks) {
+        abandon(*chunk);
+        if (chunk.use_count() > 1) {
+            continue;
+        }
+        for (auto& pi : chunk->items) {
+            if (pi.use_count() == 1 && as_playlist(pi.get()) != nullptr) {
+                released.push_back(std::move(pi));
+            }
+        }
+    }
+    list_to_play.chunks.clear();
+    list_to_play.ends.clear();
+}
+//zwraca element z danej pozycji
+const std::shared_ptr<PlaylistInterface>& Playlist::item_at
+        (size_t position) const {
+    return *list_to_play.at(position);
+}
+//zwraca kawalek do zmiany w miejscu; kopiuje go najpierw, jesli jest
+//wspoldzielony z klonem lub z planem, ktory ktos jeszcze trzyma
+ItemChunk& Playlist::writable_chunk(size_t index) {
+    std::shared_ptr<ItemChunk>& chunk = list_to_play.chunks[index];
+    if (chunk.use_count() > 1) {
+        auto copy = std::make_shared<ItemChunk>();
+        copy->items = chunk->items;
+        abandon(*chunk);
+        chunk = std::move(copy);
+        adopt(*chunk);
+    }
+    return *chunk;
+}
+//tworzy kawalek tej playlisty z podanych elementow
+std::shared_ptr<ItemChunk> Playlist::make_chunk
+        (std::vector<std::shared_ptr<PlaylistInterface>>::iterator first,
+         std::vector<std::shared_ptr<PlaylistInterface>>::iterator last) {
+    auto chunk = std::make_shared<ItemChunk>();
+    chunk->items.assign(std::make_move_iterator(first),
+                        std::make_move_iterator(last));
+    adopt(*chunk);
+    return chunk;
+}
+//dzieli kawalek: elementy od pozycji at trafiaja do nowego kawalka za nim
+void Playlist::split_chunk(size_t index, size_t at) {
+    ItemChunk& chunk = writable_chunk(index);
+    for (size_t i = at; i < chunk.items.size(); i++) {
+        unlink_item(chunk, chunk.items[i].get());
+    }
+    auto rest = make_chunk(chunk.items.begin() + static_cast<std::ptrdiff_t>(at),
+                           chunk.items.end());
+    chunk.items.resize(at);
+    list_to_play.chunks.insert(list_to_play.chunks.begin() +
+                               static_cast<std::ptrdiff_t>(index + 1),
+                               std::move(rest));
+}
+//laczy kawalek z nastepnym, jesli razem sa nie wieksze od zwyklego
+//kawalka; dzieki temu usuwanie nie zostawia wielu malych kawalkow
+void Playlist::merge_chunks(size_t index) {
+    auto& chunks = list_to_play.chunks;
+    if (index + 1 >= chunks.size() ||
+        chunks[index]->items.size() + chunks[index + 1]->items.size() >
+        CHUNK_ITEMS) {
+        return;
+    }
+    ItemChunk& chunk = writable_chunk(index);
+    std::shared_ptr<ItemChunk> next = std::move(chunks[index + 1]);
+    chunks.erase(chunks.begin() + static_cast<std::ptrdiff_t>(index + 1));
+    abandon(*next);
+    for (auto& pi : next->items) {
+        link_item(chunk, pi.get());
+        chunk.items.push_back(pi);
+    }
+}
+//przelicza konce kawalkow od kawalka index
+void Playlist::recount(size_t index) {
+    auto& chunks = list_to_play.chunks;
+    auto& ends = list_to_play.ends;
+    ends.resize(chunks.size());
+    for (size_t i = index; i < chunks.size(); i++) {
+        ends[i] = (i == 0 ? 0 : ends[i - 1]) + chunks[i]->items.size();
+    }
+}
+//wstawia jeden element na pozycje, jak place_items, ale bez tworzenia
+//wektora elementow
+void Playlist::place_item(size_t position,
+                          const std::shared_ptr<PlaylistInterface>& pi) {
+    invalidate();
+    auto& chunks = list_to_play.chunks;
+    if (chunks.empty()) {
+        auto chunk = std::make_shared<ItemChunk>();
+        chunk->items.push_back(pi);
+        adopt(*chunk);
+        chunks.push_back(std::move(chunk));
+        recount(0);
+        return;
+    }
+    size_t index = chunks.size() - 1;
+    size_t offset = chunks[index]->items.size();
+    if (position < list_to_play.size()) {
+        index = list_to_play.locate(position, offset);
+    }
+    ItemChunk& chunk = writable_chunk(index);
+    link_item(chunk, pi.get());
+    chunk.items.insert(chunk.items.begin() + static_cast<std::ptrdiff_t>(offset),
+                       pi);
+    if (chunk.items.size() > 2 * CHUNK_ITEMS) {
+        split_chunk(index, chunk.items.size() / 2);
+    }
+    recount(index);
+}
+//wstawia elementy na pozycje, dowiazujac je do kawalkow, ale bez
+//podsumowan. Kilka elementow trafia do istniejacego kawalka, ktory
+//w razie potrzeby jest dzielony; wiecej - do nowych kawalkow
+void Playlist::place_items
+        (size_t position,
+         std::vector<std::shared_ptr<PlaylistInterface>>& new_items) {
+    if (new_items.empty()) {
+        return;
+    }
+    invalidate();
+    auto& chunks = list_to_play.chunks;
+    size_t index = chunks.size();
+    size_t offset = 0;
+    if (position < list_to_play.size()) {
+        index = list_to_play.locate(position, offset);
+    } else if (!chunks.empty()) {
+        index = chunks.size() - 1;
+        offset = chunks[index]->items.size();
+    }
+    if (index < chunks.size() && new_items.size() < CHUNK_ITEMS) {
+        ItemChunk& chunk = writable_chunk(index);
+        for (auto& pi : new_items) {
+            link_item(chunk, pi.get());
+        }
+        chunk.items.insert(chunk.items.begin() +
+                           static_cast<std::ptrdiff_t>(offset),
+                           std::make_move_iterator(new_items.begin()),
+                           std::make_move_iterator(new_items.end()));
+        if (chunk.items.size() > 2 * CHUNK_ITEMS) {
+            split_chunk(index, chunk.items.size() / 2);
+        }
+    } else {
+        size_t at = index;
+        if (index < chunks.size() && offset > 0) {
+            if (offset < chunks[index]->items.size()) {
+                split_chunk(index, offset);
+            }
+            at = index + 1;
+        }
+        std::vector<std::shared_ptr<ItemChunk>> fresh;
+        for (size_t first = 0; first < new_items.size(); first += CHUNK_ITEMS) {
+            size_t last = std::min(new_items.size(), first + CHUNK_ITEMS);
+            fresh.push_back(make_chunk(
+                    new_items.begin() + static_cast<std::ptrdiff_t>(first),
+                    new_items.begin() + static_cast<std::ptrdiff_t>(last)));
+        }
+        chunks.insert(chunks.begin() + static_cast<std::ptrdiff_t>(at),
+                      std::make_move_iterator(fresh.begin()),
+                      std::make_move_iterator(fresh.end()));
+        index = std::min(index, at);
+    }
+    new_items.clear();
+    recount(index);
+}
+//wyjmuje elementy z pozycji [first, last), bez podsumowan. Cale kawalki
+//sa tylko wypisywane, wiec kawalek wspoldzielony z klonem nie jest kopiowany
+std::vector<std::shared_ptr<PlaylistInterface>> Playlist::take_items
+        (size_t first, size_t last) {
+    std::vector<std::shared_ptr<PlaylistInterface>> taken;
+    if (first == last) {
+        return taken;
+    }
+    invalidate();
+    taken.reserve(last - first);
+    auto& chunks = list_to_play.chunks;
+    size_t offset;
+    size_t start = list_to_play.locate(first, offset);
+    size_t index = start;
+    size_t remaining = last - first;
+    while (remaining > 0) {
+        size_t size = chunks[index]->items.size();
+        size_t count = std::min(size - offset, remaining);
+        if (count == size) {
+            std::shared_ptr<ItemChunk> chunk = std::move(chunks[index]);
+            abandon(*chunk);
+            if (chunk.use_count() == 1) {
+                std::move(chunk->items.begin(), chunk->items.end(),
+                          std::back_inserter(taken));
+            } else {
+                taken.insert(taken.end(),
+                             chunk->items.begin(), chunk->items.end());
+            }
+        } else {
+            ItemChunk& chunk = writable_chunk(index);
+            auto from = chunk.items.begin() + static_cast<std::ptrdiff_t>(offset);
+            auto to = from + static_cast<std::ptrdiff_t>(count);
+            for (auto it = from; it != to; it++) {
+                unlink_item(chunk, it->get());
+                taken.push_back(std::move(*it));
+            }
+            chunk.items.erase(from, to);
+        }
+        remaining -= count;
+        index++;
+        offset = 0;
+    }
+    chunks.erase(std::remove(chunks.begin() + static_cast<std::ptrdiff_t>(start),
+                             chunks.begin() + static_cast<std::ptrdiff_t>(index),
+                             nullptr),
+                 chunks.begin() + static_cast<std::ptrdiff_t>(index));
+    if (start > 0) {
+        start--;
+    }
+    merge_chunks(start);
+    if (start + 1 < chunks.size()) {
+        merge_chunks(start + 1);
+    }
+    recount(start);
+    return taken;
+}
+//wstawia jeden element na pozycje bez sprawdzania cykli
+void Playlist::insert_item(size_t position,
+                           const std::shared_ptr<PlaylistInterface>& pi) {
+    PlayStats old_totals = totals;
+    account(pi.get(), true);
+    place_item(position, pi);
+    propagate(old_totals);
+}
+//wstawia elementy na pozycje bez sprawdzania cykli
+void Playlist::insert_items
+        (size_t position,
+         std::vector<std::shared_ptr<PlaylistInterface>>& new_items) {
+    PlayStats old_totals = totals;
+    for (auto& pi : new_items) {
+        account(pi.get(), true);
+    }
+    place_items(position, new_items);
+    propagate(old_totals);
+}
+//wyjmuje elementy z pozycji [first, last)
+std::vector<std::shared_ptr<PlaylistInterface>> Playlist::erase_items
+        (size_t first, size_t last) {
+    std::vector<std::shared_ptr<PlaylistInterface>> erased =
+            take_items(first, last);
+    PlayStats old_totals = totals;
+    for (auto& pi : erased) {
+        account(pi.get(), false);
+    }
+    propagate(old_totals);
+    return erased;
+}
+//przenosi count elementow z pozycji first na pozycje position
+//(liczona po ich wyjeciu)
+void Playlist::move_items(size_t first, size_t count, size_t position) {
+    std::vector<std::shared_ptr<PlaylistInterface>> moved =
+            take_items(first, first + count);
+    place_items(position, moved);
+}
+//na pozycji i ustawia element z pozycji permutation[i]
+void Playlist::permute_items(const std::vector<size_t>& permutation) {
+    std::vector<std::shared_ptr<PlaylistInterface>> old_items =
+            take_items(0, list_to_play.size());
+    std::vector<std::shared_ptr<PlaylistInterface>> new_items;
+    new_items.reserve(old_items.size());
+    for (size_t position : permutation) {
+        new_items.push_back(std::move(old_items[position]));
+    }
+    place_items(0, new_items);
+}
+//zapisuje zmiane w historii, usuwajac najstarsze ponad limit
+void Playlist::record(Edit&& edit) {
+    version++;
+    if (history_limit == 0) {
+        return;
+    }
+    for (auto& pi : edit.items) {
+        if (as_playlist(pi.get()) != nullptr) {
+            edit.playlists.push_back(pi);
+            pi = nullptr;
+        }
+    }
+    history.push_back(std::move(edit));
+    if (history.size() > history_limit) {
+        history.pop_front();
+    }
+}
+//powiadamia kolejno obserwatorow. Wyjatek obserwatora nie zatrzymuje
+//powiadamiania pozostalych; pierwszy z nich jest rzucany na koniec,
+//a zmiana zostaje wykonana
+template <typename Call>
+void Playlist::notify(const Call& call) {
+    std::exception_ptr failure;
+    for (PlaylistObserver* observer : observers) {
+        try {
+            call(observer);
+        } catch (...) {
+            if (!failure) {
+                failure = std::current_exception();
+            }
+        }
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+//powiadamia obserwatorow o wstawieniu count elementow od pozycji position
+void Playlist::notify_inserted(size_t position, size_t count) {
+    if (observers.empty()) {
+        return;
+    }
+    auto first = list_to_play.at(position);
+    notify([&](PlaylistObserver* observer) {
+        observer->inserted(*this, position, first, count);
+    });
+}
+void Playlist::notify_erased(size_t first, size_t last) {
+    notify([&](PlaylistObserver* observer) {
+        observer->erased(*this, first, last);
+    });
+}
+void Playlist::notify_moved(size_t first, size_t count, size_t position) {
+    notify([&](PlaylistObserver* observer) {
+        observer->moved(*this, first, count, position);
+    });
+}
+void Playlist::notify_reordered(const std::vector<size_t>& permutation) {
+    notify([&](PlaylistObserver* observer) {
+        observer->reordered(*this, permutation);
+    });
+}
+void Playlist::notify_mode_changed() {
+    notify([&](PlaylistObserver* observer) {
+        observer->mode_changed(*this, mode);
+    });
+}
+//powiadamia obserwatorow o operacji, ktora cofnela zmiane edit
+void Playlist::notify_undone(const Edit& edit) {
+    switch (edit.kind) {
+        case Edit::INSERTED:
+            notify_erased(edit.position, edit.position + edit.count);
+            break;
+        case Edit::ERASED:
+            notify_inserted(edit.position, edit.count);
+            break;
+        case Edit::MOVED:
+            notify_moved(edit.target, edit.count, edit.position);
+            break;
+        case Edit::REORDERED:
+            notify_reordered(edit.permutation);
+            break;
+        case Edit::MODE_CHANGED:
+            notify_mode_changed();
+            break;
+    }
+}
+//zapisuje obserwatora zmian tej playlisty
+void Playlist::addObserver(PlaylistObserver* observer) {
+    observers.push_back(observer);
+}
+//wypisuje obserwatora zmian tej playlisty
+void Playlist::removeObserver(PlaylistObserver* observer) {
+    auto it = std::find(observers.begin(), observers.end(), observer);
+    if (it != observers.end()) {
+        observers.erase(it);
+    }
+}
+//dodaje nowy element do playlisty
+void Playlist::add(const std::shared_ptr<PlaylistInterface>& pi) {
+    add(pi, list_to_play.size());
+}
+//dodaje nowy element, na konkretna pozycje w liscie
+//lub rzuca wyjatek, gdy pozycja jest niepoprawna
+void Playlist::add
+        (const std::shared_ptr<PlaylistInterface>& pi, size_t position) {
+    if (position > list_to_play.size()) {
+        throw WrongPosition();
+    }
+    if (pi->is_collision(this)) {
+        throw NoCyclesAllowed();
+    }
+    insert_item(position, pi);
+    record({Edit::INSERTED, position, 1, 0, {}, {}, nullptr});
+    notify_inserted(position, 1);
+}
+//usuwa ostatni element
+void Playlist::remove() {
+    if (!list_to_play.empty()) {
+        remove(list_to_play.size() - 1);
+    }
+    else {
+        throw RemoveError();
+    }
+}
+//usuwa element z okreslonej pozycji
+//lub rzuca wyjatek, gdy pozycja jest niepoprawna
+void Playlist::remove(size_t position) {
+    size_t list_size = list_to_play.size();
+    bool var1 = (position == 0 && list_size == 0);
+    bool var2 = (position > 0 && list_size <= position);
+    if (var1 || var2) {
+        throw RemoveError();
+    }
+    std::vector<std::shared_ptr<PlaylistInterface>> erased =
+            erase_items(position, position + 1);
+    record({Edit::ERASED, position, 1, 0, std::move(erased), {}, nullptr});
+    notify_erased(position, position + 1);
+}
+//sprawdza, czy ktorys z podanych elementow jest ta playlista lub
+//playlista, ktora ja zawiera - wtedy jego dodanie utworzyloby cykl.
+//Idzie w gore po dowiazaniach do rodzicow, na jawnym stosie,
+//odwiedzajac kazda playliste raz, wiec wspoldzielone podplaylisty
+//i bardzo gleboka hierarchia nie sa problemem
+bool Playlist::contained_in(const std::vector<PlaylistInterface*>& roots) {
+    std::unordered_set<PlaylistInterface*> candidates;
+    for (PlaylistInterface* pi : roots) {
+        if (as_playlist(pi) != nullptr) {
+            candidates.insert(pi);
+        }
+    }
+    if (candidates.empty()) {
+        return false;
+    }
+    std::vector<Playlist*> to_visit {this};
+    std::unordered_set<Playlist*> visited {this};
+    while (!to_visit.empty()) {
+        Playlist* pl = to_visit.back();
+        to_visit.pop_back();
+        if (candidates.count(pl) > 0) {
+            return true;
+        }
+        for (ItemChunk* chunk : pl->parents) {
+            for (Playlist* parent : chunk->owners) {
+                if (visited.insert(parent).second) {
+                    to_visit.push_back(parent);
+                }
+            }
+        }
+    }
+    return false;
+}
+//sprawdza, czy target jest ta playlista lub playlista, ktora ja zawiera.
+//Po lancuchu playlist zawartych w jednym miejscu idzie bez kontenerow,
+//a przy wielu rodzicach przechodzi do contained_in
+bool Playlist::has_ancestor(Playlist* target) {
+    Playlist* pl = this;
+    while (pl != target) {
+        if (pl->parents.empty()) {
+            return false;
+        }
+        Playlist* parent = pl->only_parent();
+        if (parent == nullptr) {
+            return pl->contained_in({target});
+        }
+        pl = parent;
+    }
+    return true;
+}
+//dodaje ciag elementow na konkretna pozycje, sprawdzajac cykle
+//raz dla calego ciagu
+void Playlist::add(const std::vector<std::shared_ptr<PlaylistInterface>>& items,
+                   size_t position) {
+    if (position > list_to_play.size()) {
+        throw WrongPosition();
+    }
+    std::vector<PlaylistInterface*> roots;
+    roots.reserve(items.size());
+    for (auto& pi : items) {
+        roots.push_back(pi.get());
+    }
+    if (contained_in(roots)) {
+        throw NoCyclesAllowed();
+    }
+    std::vector<std::shared_ptr<PlaylistInterface>> new_items = items;
+    insert_items(position, new_items);
+    record({Edit::INSERTED, position, items.size(), 0, {}, {}, nullptr});
+    notify_inserted(position, items.size());
+}
+//usuwa elementy z pozycji [first, last)
+void Playlist::remove(size_t first, size_t last) {
+    if (first > last || last > list_to_play.size()) {
+        throw RemoveError();
+    }
+    std::vector<std::shared_ptr<PlaylistInterface>> erased =
+            erase_items(first, last);
+    record({Edit::ERASED, first, last - first, 0, std::move(erased),
+            {}, nullptr});
+    notify_erased(first, last);
+}
+//przenosi elementy z pozycji [first, last) playlisty other na pozycje
+//position tej playlisty (liczona juz po wyjeciu przenoszonych elementow)
+void Playlist::splice(size_t position, Playlist& other,
+                      size_t first, size_t last) {
+    if (first > last || last > other.list_to_play.size()) {
+        throw RemoveError();
+    }
+    size_t count = last - first;
+    if (&other == this) {
+        if (position > list_to_play.size() - count) {
+            throw WrongPosition();
+        }
+        move_items(first, count, position);
+        record({Edit::MOVED, first, count, position, {}, {}, nullptr});
+        notify_moved(first, count, position);
+        return;
+    }
+    if (position > list_to_play.size()) {
+        throw WrongPosition();
+    }
+    std::vector<PlaylistInterface*> roots;
+    roots.reserve(count);
+    auto from = other.list_to_play.at(first);
+    for (size_t i = 0; i < count; i++, from++) {
+        roots.push_back(from->get());
+    }
+    if (contained_in(roots)) {
+        throw NoCyclesAllowed();
+    }
+    std::vector<std::shared_ptr<PlaylistInterface>> moved =
+            other.erase_items(first, last);
+    std::vector<std::shared_ptr<PlaylistInterface>> erased;
+    if (other.history_limit > 0) {
+        erased = moved;
+    }
+    other.record({Edit::ERASED, first, count, 0, std::move(erased),
+                  {}, nullptr});
+    //blad obserwatora playlisty other jest zglaszany dopiero po
+    //wstawieniu, zeby elementy nie zginely
+    std::exception_ptr failure;
+    try {
+        other.notify_erased(first, last);
+    } catch (...) {
+        failure = std::current_exception();
+    }
+    insert_items(position, moved);
+    record({Edit::INSERTED, position, count, 0, {}, {}, nullptr});
+    notify_inserted(position, count);
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+//ustawia elementy w nowej kolejnosci: na pozycji i znajdzie sie
+//element, ktory byl na pozycji permutation[i]
+void Playlist::reorder(const std::vector<size_t>& permutation) {
+    size_t list_size = list_to_play.size();
+    if (permutation.size() != list_size) {
+        throw WrongPosition();
+    }
+    std::vector<bool> used(list_size, false);
+    for (size_t position : permutation) {
+        if (position >= list_size || used[position]) {
+            throw WrongPosition();
+        }
+        used[position] = true;
+    }
+    permute_items(permutation);
+    std::vector<size_t> inverse;
+    if (history_limit > 0) {
+        inverse.resize(list_size);
+        for (size_t i = 0; i < list_size; i++) {
+            inverse[permutation[i]] = i;
+        }
+    }
+    record({Edit::REORDERED, 0, list_size, 0, {}, std::move(inverse),
+            nullptr});
+    notify_reordered(permutation);
+}
+//ustawia nowa metode odtwarzania
+void Playlist::setMode(std::shared_ptr<Mode> new_mode) {
+    std::shared_ptr<Mode> old_mode = std::move(mode);
+    mode = std::move(new_mode);
+    invalidate();
+    record({Edit::MODE_CHANGED, 0, 0, 0, {}, {}, std::move(old_mode)});
+    notify_mode_changed();
+}
+//tworzy kopie playlisty o tej samej nazwie
+std::shared_ptr<Playlist> Playlist::clone() {
+    return clone(name);
+}
+//tworzy kopie playlisty: kopia wspoldzieli kawalki listy z oryginalem,
+//wiec kosztuje tyle, co tablica kawalkow, a kazda pozniejsza zmiana
+//kopiuje najwyzej kawalki, ktorych dotyczy. Podplaylisty sa dowiazane
+//do kawalkow, a nie do playlist, wiec nie trzeba ich dowiazywac do kopii.
+//Historia zmian nie jest kopiowana, tylko jej limit
+std::shared_ptr<Playlist> Playlist::clone(const char* new_name) {
+    auto copy = std::make_shared<Playlist>(new_name);
+    copy->list_to_play = list_to_play;
+    copy->mode = mode;
+    copy->history_limit = history_limit;
+    copy->totals = totals;
+    copy->child_depths = child_depths;
+    for (auto& chunk : copy->list_to_play.chunks) {
+        copy->adopt(*chunk);
+    }
+    if (new_name == name && plan) {
+        copy->plan = plan;
+        copy->derived = true;
+    }
+    return copy;
+}
+//ustawia, ile ostatnich zmian mozna cofnac (0 wylacza historie)
+void Playlist::setHistoryLimit(size_t limit) {
+    history_limit = limit;
+    while (history.size() > history_limit) {
+        history.pop_front();
+    }
+}
+//cofa ostatnia zapamietana zmiane; zwraca false, gdy nie ma czego cofac.
+//Przywrocenie usunietej podplaylisty moze utworzyc cykl, jesli
+//w miedzyczasie zmieniono inna playliste - wtedy rzuca wyjatek
+//i zmiana zostaje w historii. Gdy usunieta podplaylista zostala juz
+//zwolniona, rzuca UndoError i czysci historie, bo nie da sie cofnac
+//ani tej zmiany, ani zadnej wczesniejszej
+bool Playlist::undo() {
+    if (history.empty()) {
+        return false;
+    }
+    Edit& edit = history.back();
+    switch (edit.kind) {
+        case Edit::INSERTED:
+            erase_items(edit.position, edit.position + edit.count);
+            break;
+        case Edit::ERASED: {
+            std::vector<std::shared_ptr<PlaylistInterface>> restored =
+                    edit.items;
+            size_t next = 0;
+            for (auto& pi : restored) {
+                if (pi == nullptr) {
+                    pi = edit.playlists[next++].lock();
+                    if (pi == nullptr) {
+                        history.clear();
+                        throw UndoError();
+                    }
+                }
+            }
+            std::vector<PlaylistInterface*> roots;
+            roots.reserve(restored.size());
+            for (auto& pi : restored) {
+                roots.push_back(pi.get());
+            }
+            if (contained_in(roots)) {
+                throw NoCyclesAllowed();
+            }
+            insert_items(edit.position, restored);
+            break;
+        }
+        case Edit::MOVED:
+            move_items(edit.target, edit.count, edit.position);
+            break;
+        case Edit::REORDERED:
+            permute_items(edit.permutation);
+            break;
+        case Edit::MODE_CHANGED:
+            mode = std::move(edit.mode);
+            invalidate();
+            break;
+    }
+    Edit undone = std::move(history.back());
+    history.pop_back();
+    version++;
+    notify_undone(undone);
+    return true;
+}
+//splaszcza hierarchie do planu odtwarzania; plan jest zapamietywany
+//az do zmiany tej playlisty lub ktorejkolwiek z jej podplaylist.
+//Losowa kolejnosc ma stale ziarno, wiec tez daje sie splaszczyc
+std::shared_ptr<const PlayPlan> Playlist::compile() {
+    if (!plan) {
+        plan = build_plan(*mode);
+        derived = true;
+    }
+    return plan;
+}
+//tworzy plan, w ktorym ta playlista jest odtwarzana w podanym
+//sposobie, a podplaylisty w swoich; taki plan nie jest zapamietywany
+std::shared_ptr<const PlayPlan> Playlist::compile(Mode& top_mode) {
+    return build_plan(top_mode);
+}
+//przechodzi hierarchie w kolejnosci odtwarzania na jawnym stosie,
+//wywolujac visit(playlista, nullptr) dla naglowka kazdej playlisty
+//i visit(nullptr, element) dla kazdego innego elementu. Bez enter_all
+//podplaylista, ktorej sposob nie ma wlasnego order, jest zwyklym elementem
+void Playlist::traverse(Mode& top_mode,
+                        const std::function<void(Playlist*, PlaylistInterface*)>&
+                        visit, bool enter_all) {
+    struct Frame {
+        std::vector<PlaylistInterface*> items;
+        std::vector<size_t> order;
+        size_t next;
+    };
+    std::vector<Frame> stack;
+    stack.reserve(totals.depth);
+    Playlist* entered = this;
+    Mode* entered_mode = &top_mode;
+    while (entered != nullptr || !stack.empty()) {
+        if (entered != nullptr) {
+            visit(entered, nullptr);
+            stack.push_back({{}, {}, 0});
+            Frame& frame = stack.back();
+            frame.items.reserve(entered->list_to_play.size());
+            for (auto& pi : entered->list_to_play) {
+                frame.items.push_back(pi.get());
+            }
+            frame.order = entered_mode->order(frame.items);
+            entered = nullptr;
+        }
+        Frame& frame = stack.back();
+        if (frame.next == frame.order.size()) {
+            stack.pop_back();
+            continue;
+        }
+        PlaylistInterface* pi = frame.items[frame.order[frame.next++]];
+        Playlist* child = as_playlist(pi);
+        if (child != nullptr &&
+            (enter_all || child->mode->overrides_order())) {
+            entered = child;
+            entered_mode = child->mode.get();
+        } else {
+            visit(nullptr, pi);
+        }
+    }
+}
+//splaszcza cala hierarchie jednym przejsciem. Podplaylisty sa oznaczane,
+//zeby ich zmiana uniewaznila ten plan
+std::shared_ptr<const PlayPlan> Playlist::build_plan(Mode& top_mode) {
+    auto new_plan = std::make_shared<PlayPlan>();
+    new_plan->steps.reserve(totals.leaves() + totals.playlists);
+    std::unordered_set<Playlist*> seen;
+    traverse(top_mode, [&](Playlist* pl, PlaylistInterface* pi) {
+        if (pl != nullptr) {
+            new_plan->steps.push_back({pl->name, nullptr});
+            if (seen.insert(pl).second) {
+                new_plan->snapshots.push_back
+                        (std::make_shared<Items>(pl->list_to_play));
+                if (pl != this) {
+                    pl->derived = true;
+                }
+            }
+        } else {
+            new_plan->steps.push_back({nullptr, pi});
+        }
+    }, true);
+    return new_plan;
+}
+//zwraca podsumowanie calego poddrzewa w czasie stalym
+PlayStats Playlist::stats() {
+    return totals;
+}
+//zwraca liczbe roznych utworow odtwarzanych przez playliste;
+//wynik jest zapamietywany do najblizszej zmiany w poddrzewie
+size_t Playlist::distinct_items() {
+    if (distinct_known) {
+        return distinct_leaves;
+    }
+    std::unordered_set<PlaylistInterface*> leaves;
+    std::unordered_set<Playlist*> visited {this};
+    std::vector<Playlist*> to_visit {this};
+    while (!to_visit.empty()) {
+        Playlist* pl = to_visit.back();
+        to_visit.pop_back();
+        pl->derived = true;
+        for (auto& pi : pl->list_to_play) {
+            Playlist* child = as_playlist(pi.get());
+            if (child == nullptr) {
+                leaves.insert(pi.get());
+            } else if (visited.insert(child).second) {
+                to_visit.push_back(child);
+            }
+        }
+    }
+    distinct_leaves = leaves.size();
+    distinct_known = true;
+    return distinct_leaves;
+}
+//odtwarza, wedlug ustawionego sposobu; sposob bez wlasnego order
+//dostaje w play_with_mode prawdziwe elementy tej playlisty
+void Playlist::play() {
+    if (!mode->overrides_order()) {
+        std::cout<<"Playlist ["<<name<<"]"<<std::endl;
+        std::list<std::shared_ptr<PlaylistInterface>> items;
+        for (auto& pi : list_to_play) {
+            items.push_back(pi);
+        }
+        mode->play_with_mode(items);
+        return;
+    }
+    traverse(*mode, [](Playlist* pl, PlaylistInterface* pi) {
+        if (pl != nullptr) {
+            std::cout<<"Playlist ["<<pl->name<<"]"<<std::endl;
+        } else {
+            pi->play();
+        }
+    }, false);
+}
+//sprawdza czy playlisty nie tworza cykli
+//(obj jest osiagalny z tej playlisty dokladnie wtedy, gdy ta playlista
+//jest obj lub go zawiera, co sprawdza sie w gore od obj)
+bool Playlist::is_collision(PlaylistInterface* obj) {
+    Playlist* target = as_playlist(obj);
+    if (target == nullptr) {
+        return obj == this;
+    }
+    return target->has_ancestor(this);
+}
+//metoda okreslajaca, czy dana klasa moze powodowac kolizje
+bool Playlist::can_cause_collision() {
+    return true;
+}
+//abstarkcyjna klasa Play, do ktorej naleza
+// Song i Movie
+class Play : public PlaylistInterface {
+
+public:
+    Play() = default;
+    bool is_collision(PlaylistInterface* obj) override;
+    bool can_cause_collision() override;
+    PlayStats stats() override;
+    void measure(MemoryFootprint& footprint) override;
+    void play() override = 0;
+};
+//Obiekty tej klasy nie moga powodowac kolizji w postaci cykli
+bool Play::is_collision(PlaylistInterface* obj) {
+    (void)obj;
+    return false;
+}
+//Obiekty tej klasy nie moga powodowac kolizji w postaci cykli
+bool Play::can_cause_collision() {
+    return false;
+}
+//utwor nieznanego rodzaju
+PlayStats Play::stats() {
+    return {0, 0, 1, 0, 0};
+}
+//rozmiar rzeczywistego typu nie jest tu znany, wiec liczony jest
+//tylko sam Play; Song i Movie licza sie dokladnie
+void Play::measure(MemoryFootprint& footprint) {
+    footprint.items += sizeof(Play) + MemoryFootprint::CONTROL_BLOCK;
+}
+//Klasa reprezentujaca piosenke
+class Song : public Play {
+private:
+    std::string artist;
+    std::string title;
+    std::string lyrics;
+    friend class CatalogBuilder;
+    friend class PlayCodec;
+public:
+    Song(std::unordered_map<std::string, std::string>&& data, 
+            std::string&& lyrics_add);
+    PlayStats stats() override;
+    void measure(MemoryFootprint& footprint) override;
+    SpreadKey spread_key() override {
+        return {SpreadKey::ARTIST, artist};
+    }
+    void play() override;
+};
+//konstruktor klasy piosenka, ktory sprawdza 
+//czy wszytskie parametry sa podane poprawnie
+//i przejmuje napisy z metadanych bez ich kopiowania
+Song::Song(std::unordered_map<std::string, 
+        std::string>&& data, std::string&& lyrics_add) {
+    auto it = data.find("artist");
+    if (it == data.end()) {
+        throw NoNecessaryData();
+    } else {
+        artist = std::move(it->second);
+    }
+    it = data.find("title");
+    if (it == data.end()) {
+        throw NoNecessaryData();
+    } else {
+        title = std::move(it->second);
+    }
+    lyrics = std::move(lyrics_add);
+}
+//piosenka liczy sie jako jeden utwor muzyczny
+PlayStats Song::stats() {
+    return {1, 0, 0, 0, 0};
+}
+//dolicza obiekt piosenki i jej napisy
+void Song::measure(MemoryFootprint& footprint) {
+    footprint.items += sizeof(Song) + MemoryFootprint::CONTROL_BLOCK;
+    footprint.strings += MemoryFootprint::string_bytes(artist) +
+                         MemoryFootprint::string_bytes(title) +
+                         MemoryFootprint::string_bytes(lyrics);
+}
+//metoda odtwarzajaca piosenke
+void Song::play() {
+    std::cout<<"Song ["<<artist<<" "<<title<<"]: "<<lyrics<<std::endl;
+}
+//metoda sprawdza, czy podano poprawny format roku
+bool correct_year(const std::string& year) {
+
+    for (char const &c : year) {
+        if (c < '0' || c > '9')
+            return false;
+    }
+    return true;
+}
+//Klasa reprezentujaca film
+class Movie : public Play {
+private:
+    std::string year;
+    std::string title;
+    std::string lyrics;
+    static void unROT13(std::string &str);
+    friend class CatalogBuilder;
+    friend class PlayCodec;
+public:
+    Movie(std::unordered_map<std::string, std::string>&& data, 
+            std::string&& lyr);
+    PlayStats stats() override;
+    void measure(MemoryFootprint& footprint) override;
+    SpreadKey spread_key() override {
+        return {SpreadKey::YEAR, year};
+    }
+    void play() override;
+};
+//Konstruktor klasy Movie, ktory sprawdza czy wszytkie parametry 
+// zostaly podane poprawnie i przejmuje napisy z metadanych
+Movie::Movie(std::unordered_map<std::string, std::string>&& data, 
+        std::string&& lyr) {
+    auto it = data.find("year");
+    if (it == data.end()) {
+        throw NoNecessaryData();
+    } else {
+        std::string& new_year = it->second;
+        if (correct_year(new_year)) {
+            year = std::move(new_year);
+        } else {
+            throw WrongYear();
+        }
+    }
+    it = data.find("title");
+    if (it == data.end()) {
+        throw NoNecessaryData();
+    } else {
+        title = std::move(it->second);
+    }
+    lyrics = std::move(lyr);
+    unROT13(lyrics);
+}
+//Metoda, ktora deszyfruje ROT13 w miejscu
+void Movie::unROT13(std::string &str) {
+    for(auto& it : str) {
+        if(it >= 'A' && it <= 'M') it += 13;
+        else if(it >= 'N' && it <= 'Z') it -= 13;
+        else if(it >= 'a' && it <= 'm') it += 13;
+        else if(it >= 'n' && it <= 'z') it -= 13;
+    }
+}
+//film liczy sie jako jeden film
+PlayStats Movie::stats() {
+    return {0, 1, 0, 0, 0};
+}
+//dolicza obiekt filmu i jego napisy
+void Movie::measure(MemoryFootprint& footprint) {
+    footprint.items += sizeof(Movie) + MemoryFootprint::CONTROL_BLOCK;
+    footprint.strings += MemoryFootprint::string_bytes(year) +
+                         MemoryFootprint::string_bytes(title) +
+                         MemoryFootprint::string_bytes(lyrics);
 }
 //metoda, ktora odtwarza film
 void Movie::play() {
     std::cout<<"Movie ["<<title<<" "<<year<<"]: "<<lyrics<<std::endl;
 }
-//Klasa reprezentujaca plik i jego metadane
-class File {
-private:
-    std::unordered_map<std::string, std::string> metadata;
-    std::string file_type;
-    std::string lyrics;
-    void parse(std::string& str);
-public:
-    File(const char *str) {
-        metadata = std::unordered_map<std::string, std::string>();
-        std::string string_str = str;
-        parse(string_str);
+//Klasa reprezentujaca plik i jego metadane
+//Opis jest parsowany dopiero przy pierwszym dostepie do metadanych,
+//wiec plik znaleziony w pamieci podrecznej nie jest wcale parsowany.
+//Tam tez niepoprawny opis rzuca wyjatek, a nie w konstruktorze.
+//Parsowanie przenosi tekst z opisu, wiec potem opisu juz nie ma
+class File {
+private:
+    std::string descriptor;
+    bool parsed;
+    std::unordered_map<std::string, std::string> metadata;
+    std::string file_type;
+    std::string lyrics;
+    void parse(std::string& str);
+    void ensure_parsed() {
+        if (!parsed) {
+            parse(descriptor);
+            parsed = true;
+        }
+    }
+public:
+    File(const char *str) {
+        metadata = std::unordered_map<std::string, std::string>();
+        descriptor = str;
+        parsed = false;
+    }
+    //opis pliku; poprawny tylko przed pierwszym dostepem do metadanych
+    const std::string& get_descriptor() const {
+        return descriptor;
+    }
+    std::string& get_file_type() {
+        ensure_parsed();
+        return file_type;
+    }
+
+    std::unordered_map<std::string, std::string>& get_metadata() {
+        ensure_parsed();
+        return metadata;
+    }
+    std::string& get_lyrics() {
+        ensure_parsed();
+        return lyrics;
+    }
+    //oddaja metadane, plik nie jest potem ich wlascicielem
+    std::unordered_map<std::string, std::string>&& take_metadata() {
+        ensure_parsed();
+        return std::move(metadata);
+    }
+    //oddaja tekst, plik nie jest potem jego wlascicielem
+    std::string&& take_lyrics() {
+        ensure_parsed();
+        return std::move(lyrics);
+    }
+};
+//metoda, ktora pasrduje nazwe pliku i wydziela metadane
+//przesuwajac sie iteratorem po napisie, zamiast kopiowac jego reszte;
+//tekst jest przenoszony z konca napisu
+void File::parse(std::string& str) {
+    std::smatch m;
+    static const std::regex e1("^(audio|video)\\|");
+    static const std::regex e2("([a-zA-Z0-9 ]+):");
+    static const std::regex e3("[^|]*\\|");
+    static const std::regex e4(R"([a-zA-Z0-9\,\.\!\?\'\:\;\-\ ]+)");
+    if (!std::regex_search(str, m, e1)) {
+        if (!std::regex_search(str, m, e3)) {
+            throw CorruptFile();
+        } else {
+            throw WrongType();
+        }
+    }
+    file_type = m.str(1);
+    auto pos = m.suffix().first;
+
+    while (std::regex_search(pos, str.cend(), m, e2)) {
+        std::string data_type = m.str(1);
+        pos = m.suffix().first;
+        if (!std::regex_search(pos, str.cend(), m, e3)) {
+            throw WrongLyrics();
+        }
+        std::string new_data(m[0].first, m[0].second - 1);
+
+        metadata.emplace(std::move(data_type), std::move(new_data));
+
+        pos = m.suffix().first;
+    }
+    if (std::regex_match(pos, str.cend(), m, e4)) {
+        str.erase(str.cbegin(), pos);
+        lyrics = std::move(str);
+    } else {
+        throw WrongLyrics();
+    }
+}
+//Abstrakcyjna metoda, reprezentujaca klasy, ktore
+//tworza nowe obiekty klas
+class PlayFactory {
+public:
+    virtual std::shared_ptr<Play> create_play(File&& file) = 0;
+
+    virtual ~PlayFactory() = default;
+};
+//Twory obiekt klasy Song
+class AudioFactory : public PlayFactory {
+public:
+    AudioFactory() = default;
+    std::shared_ptr<Play> create_play(File&& file) override ;
+};
+//metoda tworzaca nowy obiekt klasy Song, przenoszac do niego dane pliku
+std::shared_ptr<Play> AudioFactory::create_play(File&& file) {
+    std::shared_ptr<Play> play = std::make_shared<Song>
+            (file.take_metadata(), file.take_lyrics());
+    return play;
+}
+//klasa tworzaca nowy obiekt klasy Movie
+class MovieFactory : public PlayFactory {
+public:
+    MovieFactory() = default;
+    std::shared_ptr<Play> create_play(File&& file) override ;
+};
+//metoda tworzaca nowy obiekt klasy Movie, przenoszac do niego dane pliku
+std::shared_ptr<Play> MovieFactory::create_play(File &&file) {
+    std::shared_ptr<Play> play =  std::make_shared<Movie>
+                                  (file.take_metadata(), file.take_lyrics());
+    return play;
+}
+//Rejestr nadajacy elementom zwarte, 4-bajtowe numery. Ten sam element
+//dostaje zawsze ten sam numer; numery sa nadawane po kolei od zera
+class ItemRegistry {
+private:
+    std::vector<std::shared_ptr<PlaylistInterface>> items;
+    std::unordered_map<PlaylistInterface*, uint32_t> ids;
+public:
+    uint32_t id_of(const std::shared_ptr<PlaylistInterface>& pi);
+    const std::shared_ptr<PlaylistInterface>& get(uint32_t id) const;
+    size_t size() const {
+        return items.size();
+    }
+    MemoryFootprint footprint() const;
+};
+//zwraca numer elementu, rejestrujac go przy pierwszym uzyciu
+uint32_t ItemRegistry::id_of(const std::shared_ptr<PlaylistInterface>& pi) {
+    auto it = ids.find(pi.get());
+    if (it != ids.end()) {
+        return it->second;
+    }
+    if (items.size() > UINT32_MAX) {
+        throw WrongPosition();
+    }
+    uint32_t id = static_cast<uint32_t>(items.size());
+    items.push_back(pi);
+    ids.emplace(pi.get(), id);
+    return id;
+}
+//zwraca element o danym numerze
+const std::shared_ptr<PlaylistInterface>& ItemRegistry::get(uint32_t id) const {
+    if (id >= items.size()) {
+        throw WrongPosition();
+    }
+    return items[id];
+}
+//podaje pamiec rejestru i zarejestrowanych elementow
+MemoryFootprint ItemRegistry::footprint() const {
+    MemoryFootprint footprint {};
+    footprint.indexes =
+            items.capacity() * sizeof(std::shared_ptr<PlaylistInterface>) +
+            ids.bucket_count() * sizeof(void*) +
+            ids.size() * MemoryFootprint::hash_node
+                    (sizeof(std::pair<PlaylistInterface* const, uint32_t>));
+    for (auto& pi : items) {
+        pi->measure(footprint);
+    }
+    return footprint;
+}
+//Playlista trzymajaca swoje elementy na dysku jako numery z rejestru,
+//w stronach po PAGE_ENTRIES numerow zapisanych w plikach segmentow.
+//W pamieci sa tylko: tablica stron (kilka slow na strone) i ostatnio
+//uzywane strony, ktorych laczny rozmiar nie przekracza cache_bytes
+//(co najmniej dwie strony). Odtwarzanie po kolei i OddEvenMode czyta
+//strony przez te pamiec. ShuffleMode odtwarza strony w losowej kolejnosci
+//i miesza elementy w oknach po polowie tej pamieci, wiec potrzebuje
+//dodatkowo okna (do cache_bytes / 2) i 8 bajtow na strone; kolejnosc
+//rozni sie od ShuffleMode na playliscie w pamieci. Inne sposoby
+//odtwarzania, ktore potrzebuja samych elementow, sa odrzucane (WrongMode).
+//Pliki segmentow maja unikalne nazwy (mkstemp) i sa usuwane z katalogu
+//zaraz po utworzeniu, wiec znikaja razem z playlista, a procesy nie
+//dziela plikow. Proces potomny dziedziczy jednak otwarte juz segmenty,
+//wiec po fork() playliste powinien zmieniac tylko jeden z procesow
+class DiskPlaylist : public PlaylistInterface {
+public:
+    static const size_t PAGE_ENTRIES = 4096;
+    static const size_t PAGE_BYTES = PAGE_ENTRIES * sizeof(uint32_t);
+    static const size_t SEGMENT_PAGES = 1024;
+private:
+    //strona w kolejnosci playlisty: miejsce w segmentach i liczba numerow
+    struct PageInfo {
+        size_t slot;
+        size_t count;
+    };
+    //strona w pamieci
+    struct CachedPage {
+        std::vector<uint32_t> entries;
+        bool dirty;
+        std::list<size_t>::iterator lru_position;
+    };
+    const char* name;
+    std::string directory;
+    std::shared_ptr<ItemRegistry> registry;
+    std::shared_ptr<Mode> mode;
+    std::vector<PageInfo> pages;
+    //pozycja pierwszego elementu kazdej strony, przeliczana po zmianie
+    std::vector<size_t> page_starts;
+    bool starts_valid;
+    size_t last_page;
+    std::vector<size_t> free_slots;
+    size_t next_slot;
+    std::vector<int> segments;
+    size_t cache_pages;
+    //miejsca stron w pamieci, od ostatnio do najdawniej uzytej
+    std::list<size_t> lru;
+    std::unordered_map<size_t, CachedPage> cache;
+    size_t entry_count;
+    PlayStats totals;
+    std::vector<ItemChunk*> parents;
+    int segment_fd(size_t slot);
+    size_t allocate_slot();
+    void release_slot(size_t slot);
+    std::vector<uint32_t>& load(size_t page, bool for_write);
+    void evict();
+    size_t locate(size_t position, size_t& offset);
+    uint32_t entry_at(size_t position);
+    void insert_at(size_t position, uint32_t id);
+    void changed(const PlayStats& before);
+    void append_page(size_t page, std::vector<uint32_t>& window);
+    void play_shuffled(size_t seed);
+public:
+    DiskPlaylist(const char* myname, std::string dir,
+                 std::shared_ptr<ItemRegistry> items_registry,
+                 size_t cache_bytes);
+    DiskPlaylist(const DiskPlaylist&) = delete;
+    DiskPlaylist& operator=(const DiskPlaylist&) = delete;
+    ~DiskPlaylist() override;
+    void add(const std::shared_ptr<Play>& play);
+    void add(const std::shared_ptr<Play>& play, size_t position);
+    void remove();
+    void remove(size_t position);
+    void setMode(std::shared_ptr<Mode> new_mode);
+    size_t size() const {
+        return entry_count;
+    }
+    size_t resident_pages() const {
+        return cache.size();
+    }
+    void play() override;
+    bool is_collision(PlaylistInterface* obj) override;
+    bool can_cause_collision() override;
+    PlayStats stats() override;
+    bool attach_parent(ItemChunk* parent) override;
+    bool detach_parent(ItemChunk* parent) override;
+    void measure(MemoryFootprint& footprint) override;
+};
+//tworzy pusta playliste; pamiec na strony to co najmniej dwie strony
+DiskPlaylist::DiskPlaylist(const char* myname, std::string dir,
+                           std::shared_ptr<ItemRegistry> items_registry,
+                           size_t cache_bytes) {
+    name = myname;
+    directory = std::move(dir);
+    registry = std::move(items_registry);
+    mode = std::make_shared<SequenceMode>();
+    starts_valid = true;
+    last_page = 0;
+    next_slot = 0;
+    cache_pages = std::max<size_t>(2, cache_bytes / PAGE_BYTES);
+    entry_count = 0;
+    totals = {0, 0, 0, 1, 1};
+}
+//zamyka pliki segmentow; ich nazwy zostaly usuniete juz przy tworzeniu
+DiskPlaylist::~DiskPlaylist() {
+    for (int fd : segments) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+}
+//zwraca deskryptor pliku segmentu z danym miejscem, tworzac go w razie
+//potrzeby jako nowy plik o unikalnej nazwie
+int DiskPlaylist::segment_fd(size_t slot) {
+    size_t segment = slot / SEGMENT_PAGES;
+    while (segments.size() <= segment) {
+        segments.push_back(-1);
+    }
+    if (segments[segment] < 0) {
+        std::string path = directory + "/jnp6_segment_XXXXXX";
+        int fd = ::mkstemp(&path[0]);
+        if (fd < 0) {
+            throw DiskError();
+        }
+        ::unlink(path.c_str());
+        segments[segment] = fd;
+    }
+    return segments[segment];
+}
+//przydziela miejsce na nowa strone, najpierw z zwolnionych
+size_t DiskPlaylist::allocate_slot() {
+    if (!free_slots.empty()) {
+        size_t slot = free_slots.back();
+        free_slots.pop_back();
+        return slot;
+    }
+    return next_slot++;
+}
+//zwalnia miejsce pustej strony razem z jej kopia w pamieci
+void DiskPlaylist::release_slot(size_t slot) {
+    auto it = cache.find(slot);
+    if (it != cache.end()) {
+        lru.erase(it->second.lru_position);
+        cache.erase(it);
+    }
+    free_slots.push_back(slot);
+}
+//usuwa z pamieci najdawniej uzywana strone, zapisujac ja, jesli
+//zostala zmieniona
+void DiskPlaylist::evict() {
+    size_t slot = lru.back();
+    CachedPage& cached = cache.at(slot);
+    if (cached.dirty) {
+        size_t bytes = cached.entries.size() * sizeof(uint32_t);
+        off_t offset = static_cast<off_t>((slot % SEGMENT_PAGES) * PAGE_BYTES);
+        if (::pwrite(segment_fd(slot), cached.entries.data(), bytes, offset)
+            != static_cast<ssize_t>(bytes)) {
+            throw DiskError();
+        }
+    }
+    lru.pop_back();
+    cache.erase(slot);
+}
+//zwraca numery strony o danym indeksie, wczytujac ja w razie potrzeby
+std::vector<uint32_t>& DiskPlaylist::load(size_t page, bool for_write) {
+    const PageInfo& info = pages[page];
+    auto it = cache.find(info.slot);
+    if (it == cache.end()) {
+        if (cache.size() >= cache_pages) {
+            evict();
+        }
+        CachedPage cached;
+        cached.entries.resize(info.count);
+        cached.dirty = false;
+        size_t bytes = info.count * sizeof(uint32_t);
+        off_t offset = static_cast<off_t>((info.slot % SEGMENT_PAGES)
+                                          * PAGE_BYTES);
+        if (bytes > 0 && ::pread(segment_fd(info.slot), cached.entries.data(),
+                                 bytes, offset)
+                         != static_cast<ssize_t>(bytes)) {
+            throw DiskError();
+        }
+        lru.push_front(info.slot);
+        cached.lru_position = lru.begin();
+        it = cache.emplace(info.slot, std::move(cached)).first;
+    } else {
+        lru.splice(lru.begin(), lru, it->second.lru_position);
+    }
+    if (for_write) {
+        it->second.dirty = true;
+    }
+    return it->second.entries;
+}
+//znajduje strone z elementem na danej pozycji; przy odtwarzaniu po kolei
+//zwykle jest to ta sama strona co poprzednio
+size_t DiskPlaylist::locate(size_t position, size_t& offset) {
+    if (!starts_valid) {
+        page_starts.resize(pages.size());
+        size_t start = 0;
+        for (size_t page = 0; page < pages.size(); page++) {
+            page_starts[page] = start;
+            start += pages[page].count;
+        }
+        starts_valid = true;
+    }
+    size_t page = last_page;
+    if (page >= pages.size() || position < page_starts[page] ||
+        position >= page_starts[page] + pages[page].count) {
+        auto it = std::upper_bound(page_starts.begin(), page_starts.end(),
+                                   position);
+        page = static_cast<size_t>(it - page_starts.begin()) - 1;
+    }
+    last_page = page;
+    offset = position - page_starts[page];
+    return page;
+}
+//zwraca numer elementu na danej pozycji
+uint32_t DiskPlaylist::entry_at(size_t position) {
+    size_t offset;
+    size_t page = locate(position, offset);
+    return load(page, false)[offset];
+}
+//wstawia numer na pozycje; pelna strona jest dzielona na pol
+void DiskPlaylist::insert_at(size_t position, uint32_t id) {
+    if (pages.empty() || (position == entry_count &&
+                          pages.back().count == PAGE_ENTRIES)) {
+        pages.push_back({allocate_slot(), 0});
+    }
+    size_t page;
+    size_t offset;
+    if (position == entry_count) {
+        page = pages.size() - 1;
+        offset = pages[page].count;
+    } else {
+        page = locate(position, offset);
+    }
+    if (pages[page].count == PAGE_ENTRIES) {
+        size_t half = PAGE_ENTRIES / 2;
+        pages.insert(pages.begin() + static_cast<std::ptrdiff_t>(page) + 1,
+                     {allocate_slot(), 0});
+        std::vector<uint32_t> upper;
+        {
+            std::vector<uint32_t>& lower = load(page, true);
+            upper.assign(lower.begin() + static_cast<std::ptrdiff_t>(half),
+                         lower.end());
+            lower.resize(half);
+        }
+        pages[page].count = half;
+        load(page + 1, true) = std::move(upper);
+        pages[page + 1].count = PAGE_ENTRIES - half;
+        if (offset > half) {
+            page++;
+            offset -= half;
+        }
+    }
+    std::vector<uint32_t>& entries = load(page, true);
+    entries.insert(entries.begin() + static_cast<std::ptrdiff_t>(offset), id);
+    pages[page].count++;
+    entry_count++;
+    starts_valid = false;
+}
+//powiadamia zawierajace playlisty o zmianie podsumowania
+void DiskPlaylist::changed(const PlayStats& before) {
+    for (ItemChunk* chunk : parents) {
+        for (Playlist* parent : chunk->get_owners()) {
+            parent->child_changed(before, totals);
+        }
+    }
+}
+//dodaje utwor na koniec playlisty
+void DiskPlaylist::add(const std::shared_ptr<Play>& play) {
+    add(play, entry_count);
+}
+//dodaje utwor na dana pozycje
+void DiskPlaylist::add(const std::shared_ptr<Play>& play, size_t position) {
+    if (position > entry_count) {
+        throw WrongPosition();
+    }
+    insert_at(position, registry->id_of(play));
+    PlayStats before = totals;
+    PlayStats st = play->stats();
+    totals.songs += st.songs;
+    totals.movies += st.movies;
+    totals.others += st.others;
+    changed(before);
+}
+//usuwa ostatni element
+void DiskPlaylist::remove() {
+    if (entry_count == 0) {
+        throw RemoveError();
+    }
+    remove(entry_count - 1);
+}
+//usuwa element z danej pozycji
+void DiskPlaylist::remove(size_t position) {
+    if (position >= entry_count) {
+        throw RemoveError();
+    }
+    size_t offset;
+    size_t page = locate(position, offset);
+    std::vector<uint32_t>& entries = load(page, true);
+    uint32_t id = entries[offset];
+    entries.erase(entries.begin() + static_cast<std::ptrdiff_t>(offset));
+    if (--pages[page].count == 0) {
+        release_slot(pages[page].slot);
+        pages.erase(pages.begin() + static_cast<std::ptrdiff_t>(page));
+    }
+    entry_count--;
+    starts_valid = false;
+    PlayStats before = totals;
+    PlayStats st = registry->get(id)->stats();
+    totals.songs -= st.songs;
+    totals.movies -= st.movies;
+    totals.others -= st.others;
+    changed(before);
+}
+//ustawia nowa metode odtwarzania; przyjmuje ShuffleMode i sposoby, ktore
+//podaja pozycje bez dostepu do elementow
+void DiskPlaylist::setMode(std::shared_ptr<Mode> new_mode) {
+    if (dynamic_cast<ShuffleMode*>(new_mode.get()) == nullptr &&
+        !new_mode->visit_positions(0, [](size_t) {})) {
+        throw WrongMode();
+    }
+    mode = std::move(new_mode);
+}
+//dopisuje do okna numery strony; strone z pamieci bierze stamtad, bo moze
+//byc nowsza niz na dysku, a pozostale czyta bez zajmowania pamieci stron
+void DiskPlaylist::append_page(size_t page, std::vector<uint32_t>& window) {
+    const PageInfo& info = pages[page];
+    auto it = cache.find(info.slot);
+    if (it != cache.end()) {
+        window.insert(window.end(), it->second.entries.begin(),
+                      it->second.entries.end());
+        return;
+    }
+    size_t start = window.size();
+    window.resize(start + info.count);
+    size_t bytes = info.count * sizeof(uint32_t);
+    off_t offset = static_cast<off_t>((info.slot % SEGMENT_PAGES) * PAGE_BYTES);
+    if (bytes > 0 && ::pread(segment_fd(info.slot), window.data() + start,
+                             bytes, offset)
+                     != static_cast<ssize_t>(bytes)) {
+        throw DiskError();
+    }
+}
+//odtwarza losowo: strony w losowej kolejnosci, a elementy wymieszane
+//w oknach po polowie pamieci stron
+void DiskPlaylist::play_shuffled(size_t seed) {
+    std::default_random_engine engine(seed);
+    std::vector<size_t> page_order(pages.size());
+    std::iota(page_order.begin(), page_order.end(), 0);
+    std::shuffle(page_order.begin(), page_order.end(), engine);
+    size_t window_pages = std::max<size_t>(1, cache_pages / 2);
+    std::vector<uint32_t> window;
+    window.reserve(std::min(entry_count, window_pages * PAGE_ENTRIES));
+    for (size_t first = 0; first < page_order.size(); first += window_pages) {
+        size_t last = std::min(page_order.size(), first + window_pages);
+        window.clear();
+        for (size_t i = first; i < last; i++) {
+            append_page(page_order[i], window);
+        }
+        std::shuffle(window.begin(), window.end(), engine);
+        for (uint32_t id : window) {
+            registry->get(id)->play();
+        }
+    }
+}
+//odtwarza, wczytujac strony na biezaco
+void DiskPlaylist::play() {
+    std::cout<<"Playlist ["<<name<<"]"<<std::endl;
+    if (auto shuffle = dynamic_cast<ShuffleMode*>(mode.get())) {
+        play_shuffled(shuffle->get_seed());
+        return;
+    }
+    mode->visit_positions(entry_count, [this](size_t position) {
+        registry->get(entry_at(position))->play();
+    });
+}
+//zawiera tylko utwory, wiec nie moze utworzyc cyklu
+bool DiskPlaylist::is_collision(PlaylistInterface* obj) {
+    return obj == this;
+}
+bool DiskPlaylist::can_cause_collision() {
+    return false;
+}
+PlayStats DiskPlaylist::stats() {
+    return totals;
+}
+//dolicza pamiec playlisty dyskowej: tablice stron i strony w pamieci.
+//Elementy sa w rejestrze, ktory liczy sie osobno
+void DiskPlaylist::measure(MemoryFootprint& footprint) {
+    footprint.playlists += sizeof(DiskPlaylist) + MemoryFootprint::CONTROL_BLOCK;
+    footprint.strings += MemoryFootprint::string_bytes(directory);
+    footprint.links += parents.capacity() * sizeof(ItemChunk*);
+    footprint.indexes +=
+            pages.capacity() * sizeof(PageInfo) +
+            page_starts.capacity() * sizeof(size_t) +
+            free_slots.capacity() * sizeof(size_t) +
+            segments.capacity() * sizeof(int) +
+            lru.size() * MemoryFootprint::list_node(sizeof(size_t)) +
+            cache.bucket_count() * sizeof(void*) +
+            cache.size() * MemoryFootprint::hash_node
+                    (sizeof(std::pair<const size_t, CachedPage>));
+    for (auto& page : cache) {
+        footprint.pages += page.second.entries.capacity() * sizeof(uint32_t);
+    }
+}
+//zapamietuje kawalek listy, ktorego playlisty trzeba powiadamiac o zmianach
+bool DiskPlaylist::attach_parent(ItemChunk* parent) {
+    parents.push_back(parent);
+    return true;
+}
+bool DiskPlaylist::detach_parent(ItemChunk* parent) {
+    auto it = std::find(parents.begin(), parents.end(), parent);
+    if (it != parents.end()) {
+        parents.erase(it);
+    }
+    return true;
+}
+//Ograniczona pamiec podreczna obiektow Play, kluczowana surowym opisem
+//pliku. Ten sam opis daje ten sam obiekt bez ponownego parsowania;
+//po przekroczeniu pojemnosci usuwany jest najdawniej uzyty wpis
+class PlayCache {
+private:
+    struct Entry {
+        std::string descriptor;
+        std::shared_ptr<Play> play;
+    };
+    //skrot FNV-1a opisu pliku
+    struct DescriptorHash {
+        size_t operator()(std::string_view descriptor) const;
+    };
+    size_t capacity;
+    //wpisy od ostatnio do najdawniej uzytego
+    std::list<Entry> entries;
+    std::unordered_map<std::string_view, std::list<Entry>::iterator,
+                       DescriptorHash> index;
+    std::mutex lock;
+    std::atomic<size_t> hits;
+    std::atomic<size_t> misses;
+public:
+    explicit PlayCache(size_t new_capacity) : hits(0), misses(0) {
+        capacity = new_capacity;
+    }
+    std::shared_ptr<Play> find(const std::string& descriptor);
+    std::shared_ptr<Play> insert(std::string&& descriptor,
+                                 std::shared_ptr<Play> play);
+    void clear();
+    size_t size();
+    MemoryFootprint footprint();
+    size_t get_hits() const {
+        return hits;
+    }
+    size_t get_misses() const {
+        return misses;
+    }
+};
+size_t PlayCache::DescriptorHash::operator()
+            (std::string_view descriptor) const {
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : descriptor) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    return static_cast<size_t>(hash);
+}
+//zwraca zapamietany obiekt dla opisu lub nullptr
+std::shared_ptr<Play> PlayCache::find(const std::string& descriptor) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = index.find(descriptor);
+    if (it == index.end()) {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    entries.splice(entries.begin(), entries, it->second);
+    return it->second->play;
+}
+//zapamietuje obiekt dla opisu; jesli inny watek zdazyl juz zapamietac
+//obiekt dla tego opisu, zwraca tamten, zeby wszyscy dostali ten sam
+std::shared_ptr<Play> PlayCache::insert(std::string&& descriptor,
+                                        std::shared_ptr<Play> play) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = index.find(descriptor);
+    if (it != index.end()) {
+        return it->second->play;
+    }
+    if (capacity == 0) {
+        return play;
+    }
+    if (entries.size() == capacity) {
+        index.erase(entries.back().descriptor);
+        entries.pop_back();
+    }
+    entries.push_front({std::move(descriptor), play});
+    index.emplace(entries.front().descriptor, entries.begin());
+    return play;
+}
+//usuwa wszystkie wpisy
+void PlayCache::clear() {
+    std::lock_guard<std::mutex> guard(lock);
+    index.clear();
+    entries.clear();
+}
+//zwraca liczbe zapamietanych obiektow
+size_t PlayCache::size() {
+    std::lock_guard<std::mutex> guard(lock);
+    return entries.size();
+}
+//podaje pamiec pamieci podrecznej i zapamietanych obiektow
+MemoryFootprint PlayCache::footprint() {
+    std::lock_guard<std::mutex> guard(lock);
+    MemoryFootprint footprint {};
+    footprint.indexes =
+            entries.size() * MemoryFootprint::list_node(sizeof(Entry)) +
+            index.bucket_count() * sizeof(void*) +
+            index.size() * MemoryFootprint::hash_node
+                    (sizeof(std::pair<const std::string_view,
+                                      std::list<Entry>::iterator>));
+    for (auto& entry : entries) {
+        footprint.strings += MemoryFootprint::string_bytes(entry.descriptor);
+        entry.play->measure(footprint);
+    }
+    return footprint;
+}
+//Klasa reprezentujaca Player
+class Player {
+private:
+    static std::shared_ptr<PlayCache>& cache_slot();
+public:
+    static std::shared_ptr<Play> openFile(File file);
+    static std::shared_ptr<Playlist> createPlaylist(const char*);
+    static std::shared_ptr<DiskPlaylist> createDiskPlaylist
+            (const char* name, const std::string& directory,
+             std::shared_ptr<ItemRegistry> registry, size_t cache_bytes);
+    static void setCache(std::shared_ptr<PlayCache> cache);
+    static std::shared_ptr<PlayCache> getCache();
+};
+//miejsce na wspolna pamiec podreczna (domyslnie jej nie ma)
+std::shared_ptr<PlayCache>& Player::cache_slot() {
+    static std::shared_ptr<PlayCache> cache;
+    return cache;
+}
+//wlacza pamiec podreczna dla openFile, nullptr ja wylacza
+void Player::setCache(std::shared_ptr<PlayCache> cache) {
+    std::atomic_store(&cache_slot(), std::move(cache));
+}
+//zwraca uzywana pamiec podreczna
+std::shared_ptr<PlayCache> Player::getCache() {
+    return std::atomic_load(&cache_slot());
+}
+//metoda, ktora zleca stworznie nowego obiektu klasy Play;
+//gdy wlaczona jest pamiec podreczna, najpierw w niej szuka opisu pliku
+std::shared_ptr<Play> Player::openFile(File file) {
+    std::shared_ptr<PlayCache> cache = getCache();
+    //parsowanie zabiera tekst z opisu, wiec klucz jest kopiowany wczesniej
+    std::string key;
+    if (cache) {
+        std::shared_ptr<Play> cached = cache->find(file.get_descriptor());
+        if (cached) {
+            return cached;
+        }
+        key = file.get_descriptor();
+    }
+    std::shared_ptr<Play> play = nullptr;
+    if (file.get_file_type() == "audio") {
+        AudioFactory af = AudioFactory();
+        play = af.create_play(std::move(file));
+
+    } else if (file.get_file_type() == "video") {
+        MovieFactory mf = MovieFactory();
+        play = mf.create_play(std::move(file));
+    }
+    if (cache && play) {
+        play = cache->insert(std::move(key), play);
+    }
+    return play;
+}
+//metoda tworzaca nowa Playliste
+std::shared_ptr<Playlist> Player::createPlaylist(const char *name) {
+    auto playlist = std::make_shared<Playlist>(name);
+    return playlist;
+}
+//metoda tworzaca nowa Playliste trzymana na dysku
+std::shared_ptr<DiskPlaylist> Player::createDiskPlaylist
+        (const char* name, const std::string& directory,
+         std::shared_ptr<ItemRegistry> registry, size_t cache_bytes) {
+    return std::make_shared<DiskPlaylist>(name, directory,
+                                          std::move(registry), cache_bytes);
+}
+
+//Rekordy katalogu we wspoldzielonej pamieci. Zamiast wskaznikow sa
+//w nich przesuniecia od poczatku segmentu, wiec segment moze byc
+//zmapowany pod dowolnym adresem w kazdym procesie
+namespace catalog_layout {
+    const char MAGIC[8] = {'J', 'N', 'P', '6', 'C', 'A', 'T', '1'};
+    enum ItemKind : uint32_t { SONG = 0, MOVIE = 1 };
+    enum ModeKind : uint32_t { SEQUENCE = 0, ODD_EVEN = 1, SHUFFLE = 2 };
+    enum ChildKind : uint32_t { ITEM = 0, PLAYLIST = 1 };
+    struct HeaderRecord {
+        char magic[8];
+        uint64_t size;
+        uint64_t items;
+        uint64_t item_count;
+        uint64_t playlists;
+        uint64_t playlist_count;
+        uint64_t children;
+        uint64_t child_count;
+    };
+    //napisy to przesuniecia tekstow zakonczonych zerem
+    struct ItemRecord {
+        uint32_t kind;
+        uint32_t reserved;
+        uint64_t first;
+        uint64_t title;
+        uint64_t lyrics;
+    };
+    struct PlaylistRecord {
+        uint64_t name;
+        uint64_t seed;
+        uint32_t mode;
+        uint32_t reserved;
+        uint64_t first_child;
+        uint64_t child_count;
+    };
+    struct ChildRecord {
+        uint32_t kind;
+        uint32_t index;
+    };
+}
+//Buduje katalog utworow i playlist w postaci, ktora mozna raz
+//umiescic we wspoldzielonej pamieci i czytac z wielu procesow.
+//Kazdy utwor, playlista i napis jest zapisany tylko raz
+class CatalogBuilder {
+private:
+    std::vector<catalog_layout::ItemRecord> items;
+    std::vector<catalog_layout::PlaylistRecord> playlists;
+    std::vector<catalog_layout::ChildRecord> children;
+    std::string strings;
+    std::unordered_map<std::string, uint64_t> interned;
+    std::unordered_map<PlaylistInterface*, uint32_t> item_index;
+    std::unordered_map<Playlist*, uint32_t> playlist_index;
+    uint64_t intern(const std::string& str);
+    uint32_t add_item(PlaylistInterface* pi);
+    uint32_t playlist_slot(Playlist* pl, std::vector<Playlist*>& pending);
+public:
+    uint32_t add(const std::shared_ptr<Playlist>& playlist);
+    std::vector<char> build() const;
+    void publish(const std::string& shm_name) const;
+};
+//wyjatek, gdy katalogu nie da sie zbudowac lub otworzyc
+class CatalogError : public PlayerException {
+public:
+    const char* what() const noexcept override {
+        return "catalog error";
+    }
+};
+//zwraca przesuniecie napisu w tablicy napisow, dodajac go tylko raz
+uint64_t CatalogBuilder::intern(const std::string& str) {
+    auto it = interned.find(str);
+    if (it != interned.end()) {
+        return it->second;
+    }
+    uint64_t offset = strings.size();
+    strings.append(str);
+    strings.push_back('\0');
+    interned.emplace(str, offset);
+    return offset;
+}
+//dodaje utwor, o ile nie zostal dodany wczesniej
+uint32_t CatalogBuilder::add_item(PlaylistInterface* pi) {
+    auto it = item_index.find(pi);
+    if (it != item_index.end()) {
+        return it->second;
+    }
+    catalog_layout::ItemRecord item {};
+    if (auto song = dynamic_cast<Song*>(pi)) {
+        item = {catalog_layout::SONG, 0, intern(song->artist),
+                intern(song->title), intern(song->lyrics)};
+    } else if (auto movie = dynamic_cast<Movie*>(pi)) {
+        item = {catalog_layout::MOVIE, 0, intern(movie->year),
+                intern(movie->title), intern(movie->lyrics)};
+    } else {
+        throw CatalogError();
+    }
+    uint32_t index = static_cast<uint32_t>(items.size());
+    items.push_back(item);
+    item_index.emplace(pi, index);
+    return index;
+}
+//zwraca numer playlisty; nowa playlista trafia do przetworzenia
+uint32_t CatalogBuilder::playlist_slot(Playlist* pl,
+                                       std::vector<Playlist*>& pending) {
+    auto it = playlist_index.find(pl);
+    if (it != playlist_index.end()) {
+        return it->second;
+    }
+    uint32_t index = static_cast<uint32_t>(playlists.size());
+    playlists.push_back({});
+    playlist_index.emplace(pl, index);
+    pending.push_back(pl);
+    return index;
+}
+//dodaje playliste razem z cala jej hierarchia i zwraca jej numer
+uint32_t CatalogBuilder::add(const std::shared_ptr<Playlist>& playlist) {
+    std::vector<Playlist*> pending;
+    uint32_t root = playlist_slot(playlist.get(), pending);
+    while (!pending.empty()) {
+        Playlist* pl = pending.back();
+        pending.pop_back();
+        catalog_layout::PlaylistRecord record {};
+        record.name = intern(pl->name);
+        if (dynamic_cast<SequenceMode*>(pl->mode.get()) != nullptr) {
+            record.mode = catalog_layout::SEQUENCE;
+        } else if (dynamic_cast<OddEvenMode*>(pl->mode.get()) != nullptr) {
+            record.mode = catalog_layout::ODD_EVEN;
+        } else if (auto sm = dynamic_cast<ShuffleMode*>(pl->mode.get())) {
+            record.mode = catalog_layout::SHUFFLE;
+            record.seed = sm->get_seed();
+        } else {
+            throw CatalogError();
+        }
+        record.first_child = children.size();
+        record.child_count = pl->list_to_play.size();
+        for (auto& pi : pl->list_to_play) {
+            Playlist* child = Playlist::as_playlist(pi.get());
+            if (child != nullptr) {
+                children.push_back({catalog_layout::PLAYLIST,
+                                    playlist_slot(child, pending)});
+            } else {
+                children.push_back({catalog_layout::ITEM,
+                                    add_item(pi.get())});
+            }
+        }
+        playlists[playlist_index.at(pl)] = record;
+    }
+    return root;
+}
+//uklada katalog w jednym ciaglym buforze
+std::vector<char> CatalogBuilder::build() const {
+    using namespace catalog_layout;
+    auto aligned = [](uint64_t offset) { return (offset + 7) / 8 * 8; };
+    HeaderRecord header {};
+    std::copy(std::begin(MAGIC), std::end(MAGIC), header.magic);
+    header.items = aligned(sizeof(HeaderRecord));
+    header.item_count = items.size();
+    header.playlists = aligned(header.items + items.size() * sizeof(ItemRecord));
+    header.playlist_count = playlists.size();
+    header.children = aligned(header.playlists
+                              + playlists.size() * sizeof(PlaylistRecord));
+    header.child_count = children.size();
+    uint64_t strings_start = aligned(header.children
+                                     + children.size() * sizeof(ChildRecord));
+    header.size = strings_start + strings.size();
+    std::vector<char> buffer(header.size, 0);
+    std::memcpy(buffer.data(), &header, sizeof(HeaderRecord));
+    std::vector<ItemRecord> placed_items = items;
+    for (ItemRecord& item : placed_items) {
+        item.first += strings_start;
+        item.title += strings_start;
+        item.lyrics += strings_start;
+    }
+    std::vector<PlaylistRecord> placed_playlists = playlists;
+    for (PlaylistRecord& pl : placed_playlists) {
+        pl.name += strings_start;
+    }
+    std::memcpy(buffer.data() + header.items, placed_items.data(),
+                placed_items.size() * sizeof(ItemRecord));
+    std::memcpy(buffer.data() + header.playlists, placed_playlists.data(),
+                placed_playlists.size() * sizeof(PlaylistRecord));
+    std::memcpy(buffer.data() + header.children, children.data(),
+                children.size() * sizeof(ChildRecord));
+    std::memcpy(buffer.data() + strings_start, strings.data(), strings.size());
+    return buffer;
+}
+//zapisuje katalog do segmentu wspoldzielonej pamieci o danej nazwie
+//(np. "/jnp6_catalog"), zastepujac poprzedni. Stary segment nie jest
+//zmieniany: jego nazwa jest usuwana, a katalog trafia do nowego obiektu,
+//wiec procesy, ktore zmapowaly stary, dalej czytaja stary katalog.
+//Naglowek jest zapisywany na koncu, wiec proces, ktory otworzy segment
+//w trakcie zapisu, dostaje CatalogError, a nie polowe katalogu
+void CatalogBuilder::publish(const std::string& shm_name) const {
+    std::vector<char> buffer = build();
+    ::shm_unlink(shm_name.c_str());
+    int fd = ::shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        throw CatalogError();
+    }
+    const size_t header_size = sizeof(catalog_layout::HeaderRecord);
+    bool ok = ::ftruncate(fd, static_cast<off_t>(buffer.size())) == 0;
+    if (ok) {
+        void* mapped = ::mmap(nullptr, buffer.size(), PROT_WRITE, MAP_SHARED,
+                              fd, 0);
+        ok = mapped != MAP_FAILED;
+        if (ok) {
+            char* target = static_cast<char*>(mapped);
+            std::memcpy(target + header_size, buffer.data() + header_size,
+                        buffer.size() - header_size);
+            std::atomic_thread_fence(std::memory_order_release);
+            std::memcpy(target, buffer.data(), header_size);
+            ::munmap(mapped, buffer.size());
+        }
+    }
+    ::close(fd);
+    if (!ok) {
+        ::shm_unlink(shm_name.c_str());
+        throw CatalogError();
+    }
+}
+//Katalog zmapowany tylko do odczytu. Odtwarza playlisty wprost
+//z segmentu, bez tworzenia obiektow Song, Movie ani Playlist
+class SharedCatalog {
+private:
+    const char* base;
+    size_t length;
+    const catalog_layout::HeaderRecord* header() const {
+        return reinterpret_cast<const catalog_layout::HeaderRecord*>(base);
+    }
+    const catalog_layout::PlaylistRecord& playlist(size_t index) const;
+    void play_item(uint32_t index) const;
+public:
+    explicit SharedCatalog(const std::string& shm_name);
+    SharedCatalog(const SharedCatalog&) = delete;
+    SharedCatalog& operator=(const SharedCatalog&) = delete;
+    ~SharedCatalog();
+    size_t playlist_count() const {
+        return header()->playlist_count;
+    }
+    const char* playlist_name(size_t index) const;
+    void play(size_t index) const;
+    static void unpublish(const std::string& shm_name);
+};
+//mapuje segment tylko do odczytu i sprawdza jego naglowek
+SharedCatalog::SharedCatalog(const std::string& shm_name) {
+    int fd = ::shm_open(shm_name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        throw CatalogError();
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 ||
+        static_cast<size_t>(st.st_size) < sizeof(catalog_layout::HeaderRecord)) {
+        ::close(fd);
+        throw CatalogError();
+    }
+    length = static_cast<size_t>(st.st_size);
+    void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        throw CatalogError();
+    }
+    base = static_cast<const char*>(mapped);
+    if (!std::equal(std::begin(catalog_layout::MAGIC),
+                    std::end(catalog_layout::MAGIC), header()->magic) ||
+        header()->size != length) {
+        ::munmap(mapped, length);
+        throw CatalogError();
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+}
+SharedCatalog::~SharedCatalog() {
+    ::munmap(const_cast<char*>(base), length);
+}
+//usuwa nazwe segmentu; procesy, ktore go zmapowaly, dalej moga go czytac
+void SharedCatalog::unpublish(const std::string& shm_name) {
+    ::shm_unlink(shm_name.c_str());
+}
+const catalog_layout::PlaylistRecord& SharedCatalog::playlist(size_t index) const {
+    if (index >= header()->playlist_count) {
+        throw WrongPosition();
+    }
+    return reinterpret_cast<const catalog_layout::PlaylistRecord*>
+            (base + header()->playlists)[index];
+}
+const char* SharedCatalog::playlist_name(size_t index) const {
+    return base + playlist(index).name;
+}
+//odtwarza utwor w tym samym formacie co Song::play i Movie::play
+void SharedCatalog::play_item(uint32_t index) const {
+    const catalog_layout::ItemRecord& item =
+            reinterpret_cast<const catalog_layout::ItemRecord*>
+            (base + header()->items)[index];
+    if (item.kind == catalog_layout::SONG) {
+        std::cout<<"Song ["<<base + item.first<<" "<<base + item.title
+                 <<"]: "<<base + item.lyrics<<std::endl;
+    } else {
+        std::cout<<"Movie ["<<base + item.title<<" "<<base + item.first
+                 <<"]: "<<base + item.lyrics<<std::endl;
+    }
+}
+//odtwarza playliste tak jak Playlist::play, na jawnym stosie
+void SharedCatalog::play(size_t index) const {
+    struct Frame {
+        const catalog_layout::ChildRecord* children;
+        std::vector<size_t> order;
+        size_t next;
+    };
+    const catalog_layout::ChildRecord* all_children =
+            reinterpret_cast<const catalog_layout::ChildRecord*>
+            (base + header()->children);
+    std::vector<Frame> stack;
+    const catalog_layout::PlaylistRecord* entered = &playlist(index);
+    while (entered != nullptr || !stack.empty()) {
+        if (entered != nullptr) {
+            std::cout<<"Playlist ["<<base + entered->name<<"]"<<std::endl;
+            stack.push_back({all_children + entered->first_child, {}, 0});
+            std::vector<size_t>& order = stack.back().order;
+            order.reserve(entered->child_count);
+            auto collect = [&order](size_t position) {
+                order.push_back(position);
+            };
+            if (entered->mode == catalog_layout::SEQUENCE) {
+                SequenceMode().visit_positions(entered->child_count, collect);
+            } else if (entered->mode == catalog_layout::ODD_EVEN) {
+                OddEvenMode().visit_positions(entered->child_count, collect);
+            } else {
+                ShuffleMode(entered->seed)
+                        .visit_positions(entered->child_count, collect);
+            }
+            entered = nullptr;
+        }
+        Frame& frame = stack.back();
+        if (frame.next == frame.order.size()) {
+            stack.pop_back();
+            continue;
+        }
+        const catalog_layout::ChildRecord& child =
+                frame.children[frame.order[frame.next++]];
+        if (child.kind == catalog_layout::PLAYLIST) {
+            entered = &playlist(child.index);
+        } else {
+            play_item(child.index);
+        }
+    }
+}
+//wyjatek, gdy elementu lub sposobu odtwarzania nie da sie zapisac
+//albo zapisane dane sa uszkodzone
+class EncodingError : public PlayerException {
+public:
+    const char* what() const noexcept override {
+        return "encoding error";
+    }
+};
+//Zapis utworow i sposobow odtwarzania w zwartej postaci binarnej,
+//wspolny dla dziennika zmian i strumienia zmian. Liczby sa zapisywane
+//po 7 bitow na bajt, a kazdy rekord ma dlugosc i sume kontrolna,
+//wiec urwany lub uszkodzony koniec danych da sie rozpoznac
+class PlayCodec {
+public:
+    enum ItemKind : uint8_t { SONG = 0, MOVIE = 1 };
+    enum ModeKind : uint8_t {
+        SEQUENCE = 0, ODD_EVEN = 1, SHUFFLE = 2, SPREAD = 3
+    };
+    static const size_t HEADER_BYTES = 2 * sizeof(uint32_t);
+    //odczyt kolejnych pol jednego rekordu
+    class Reader {
+    private:
+        const char* pos;
+        const char* end;
+    public:
+        Reader(const char* begin, const char* finish) {
+            pos = begin;
+            end = finish;
+        }
+        uint64_t number();
+        std::string string();
+        bool done() const {
+            return pos == end;
+        }
+        size_t remaining() const {
+            return static_cast<size_t>(end - pos);
+        }
+    };
+    static void put_number(std::string& out, uint64_t value);
+    static void put_string(std::string& out, const std::string& str);
+    static void put_item(std::string& out, PlaylistInterface* pi);
+    static std::shared_ptr<PlaylistInterface> get_item(Reader& in);
+    static void put_mode(std::string& out, Mode* mode);
+    static std::shared_ptr<Mode> get_mode(Reader& in);
+    static void put_record(std::string& out, const std::string& body);
+    static bool get_record(const char*& pos, const char* end,
+                           const char*& body, size_t& size);
+    static uint32_t checksum(const char* data, size_t size);
+};
+//odczytuje liczbe zapisana przez put_number
+uint64_t PlayCodec::Reader::number() {
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (pos == end) {
+            throw EncodingError();
+        }
+        uint8_t byte = static_cast<uint8_t>(*pos++);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw EncodingError();
+}
+//odczytuje napis zapisany przez put_string
+std::string PlayCodec::Reader::string() {
+    uint64_t size = number();
+    if (size > static_cast<uint64_t>(end - pos)) {
+        throw EncodingError();
+    }
+    std::string str(pos, size);
+    pos += size;
+    return str;
+}
+//dopisuje liczbe, po 7 bitow na bajt, zaczynajac od najmlodszych
+void PlayCodec::put_number(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
     }
-    std::string& get_file_type() {
-        return file_type;
+    out.push_back(static_cast<char>(value));
+}
+//dopisuje napis poprzedzony jego dlugoscia
+void PlayCodec::put_string(std::string& out, const std::string& str) {
+    put_number(out, str.size());
+    out.append(str);
+}
+//dopisuje piosenke lub film; inne elementy nie maja zapisu
+void PlayCodec::put_item(std::string& out, PlaylistInterface* pi) {
+    if (auto song = dynamic_cast<Song*>(pi)) {
+        out.push_back(SONG);
+        put_string(out, song->artist);
+        put_string(out, song->title);
+        put_string(out, song->lyrics);
+    } else if (auto movie = dynamic_cast<Movie*>(pi)) {
+        out.push_back(MOVIE);
+        put_string(out, movie->year);
+        put_string(out, movie->title);
+        put_string(out, movie->lyrics);
+    } else {
+        throw EncodingError();
     }
-
-    std::unordered_map<std::string, std::string>& get_metadata() {
-        return metadata;
+}
+//tworzy piosenke lub film zapisany przez put_item
+std::shared_ptr<PlaylistInterface> PlayCodec::get_item(Reader& in) {
+    uint64_t kind = in.number();
+    std::string first = in.string();
+    std::unordered_map<std::string, std::string> data;
+    data.emplace("title", in.string());
+    std::string lyrics = in.string();
+    if (kind == SONG) {
+        data.emplace("artist", std::move(first));
+        return std::make_shared<Song>(std::move(data), std::move(lyrics));
     }
-    std::string& get_lyrics() {
-        return lyrics;
+    if (kind == MOVIE) {
+        //konstruktor odszyfrowuje tekst, a ROT13 jest swoja odwrotnoscia
+        data.emplace("year", std::move(first));
+        Movie::unROT13(lyrics);
+        return std::make_shared<Movie>(std::move(data), std::move(lyrics));
+    }
+    throw EncodingError();
+}
+//dopisuje jeden z wbudowanych sposobow odtwarzania
+void PlayCodec::put_mode(std::string& out, Mode* mode) {
+    if (dynamic_cast<SequenceMode*>(mode) != nullptr) {
+        out.push_back(SEQUENCE);
+    } else if (dynamic_cast<OddEvenMode*>(mode) != nullptr) {
+        out.push_back(ODD_EVEN);
+    } else if (auto sm = dynamic_cast<ShuffleMode*>(mode)) {
+        out.push_back(SHUFFLE);
+        put_number(out, sm->get_seed());
+    } else if (auto spread = dynamic_cast<SpreadMode*>(mode)) {
+        out.push_back(SPREAD);
+        put_number(out, spread->get_seed());
+    } else {
+        throw EncodingError();
+    }
+}
+//tworzy sposob odtwarzania zapisany przez put_mode
+std::shared_ptr<Mode> PlayCodec::get_mode(Reader& in) {
+    switch (in.number()) {
+        case SEQUENCE:
+            return createSequenceMode();
+        case ODD_EVEN:
+            return createOddEvenMode();
+        case SHUFFLE:
+            return createShuffleMode(static_cast<size_t>(in.number()));
+        case SPREAD:
+            return createSpreadMode(static_cast<size_t>(in.number()));
+        default:
+            throw EncodingError();
+    }
+}
+//dopisuje rekord: dlugosc i suma kontrolna tresci, a potem tresc
+void PlayCodec::put_record(std::string& out, const std::string& body) {
+    uint32_t header[2] = {static_cast<uint32_t>(body.size()),
+                          checksum(body.data(), body.size())};
+    out.append(reinterpret_cast<const char*>(header), HEADER_BYTES);
+    out.append(body);
+}
+//odczytuje rekord zaczynajacy sie na pos i przesuwa pos za niego;
+//zwraca false, gdy rekord jest niepelny lub suma sie nie zgadza
+bool PlayCodec::get_record(const char*& pos, const char* end,
+                           const char*& body, size_t& size) {
+    if (static_cast<size_t>(end - pos) < HEADER_BYTES) {
+        return false;
+    }
+    uint32_t header[2];
+    std::memcpy(header, pos, HEADER_BYTES);
+    if (header[0] > static_cast<size_t>(end - pos) - HEADER_BYTES ||
+        checksum(pos + HEADER_BYTES, header[0]) != header[1]) {
+        return false;
+    }
+    body = pos + HEADER_BYTES;
+    size = header[0];
+    pos = body + size;
+    return true;
+}
+//suma kontrolna FNV-1a
+uint32_t PlayCodec::checksum(const char* data, size_t size) {
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619U;
     }
+    return hash;
+}
+//Zmiany playlist zapisane jako rekordy, wspolne dla dziennika zmian
+//i strumienia zmian. Playlisty i utwory maja w rekordach numery nadawane
+//po kolei przy pierwszym uzyciu, a pierwszy rekord z nowym numerem
+//opisuje cala playliste lub utwor. Strona odczytujaca nadaje numery
+//w tej samej kolejnosci, wiec odtwarza ten sam stan
+class ChangeRecords {
+protected:
+    enum RecordKind : uint8_t {
+        PLAYLIST = 0, ITEM = 1, INSERT = 2, ERASE = 3, MOVE = 4,
+        REORDER = 5, MODE = 6
+    };
+    //nazwy playlist odtworzonych z rekordow
+    std::deque<std::string> names;
+    std::vector<std::shared_ptr<Playlist>> playlists;
+    std::unordered_map<Playlist*, uint32_t> playlist_ids;
+    //utwory, do ktorych odwoluja sie rekordy; trzymane, zeby adres
+    //usunietego utworu nie trafil do innego pod tym samym numerem
+    std::vector<std::shared_ptr<PlaylistInterface>> items;
+    std::unordered_map<PlaylistInterface*, uint32_t> item_ids;
+    //dopisuje tresc rekordu w postaci wlasciwej dla nosnika
+    virtual void put(std::string& out, const std::string& body) = 0;
+    //wywolywane dla kazdej playlisty, ktora dostala numer przy zapisie
+    virtual void started(Playlist& playlist) = 0;
+    void apply_record(const char* body, size_t size);
+    Playlist& applied(PlayCodec::Reader& in);
+    uint32_t playlist_ref(const std::shared_ptr<Playlist>& playlist,
+                          std::string& out);
+    void snapshot(const std::vector<std::shared_ptr<Playlist>>& fresh,
+                  std::string& out);
+    uint64_t reference(const std::shared_ptr<PlaylistInterface>& pi,
+                       std::string& out);
+    std::vector<uint64_t> references(Playlist::Items::const_iterator first,
+                                     size_t count, std::string& out);
+    void put_insert(std::string& out, uint32_t id, size_t position,
+                    const std::vector<uint64_t>& refs);
+    void put_erase(std::string& out, uint32_t id, size_t first, size_t last);
+    void put_move(std::string& out, uint32_t id, size_t first, size_t count,
+                  size_t position);
+    void put_reorder(std::string& out, uint32_t id,
+                     const std::vector<size_t>& permutation);
+    void put_mode(std::string& out, uint32_t id, Mode* mode);
+public:
+    ChangeRecords() = default;
+    ChangeRecords(const ChangeRecords&) = delete;
+    ChangeRecords& operator=(const ChangeRecords&) = delete;
+    virtual ~ChangeRecords() = default;
 };
-//metoda, ktora pasrduje nazwe pliku i wydziela metadane
-void File::parse(std::string& str) {
-    std::smatch m;
-    std::regex e1("^(audio|video)\\|");
-    std::regex e2("([a-zA-Z0-9 ]+):");
-    std::regex e3("[^|]*\\|");
-    std::regex e4(R"([a-zA-Z0-9\,\.\!\?\'\:\;\-\ ]+)");
-    if (!std::regex_search(str, m, e1)) {
-        if (!std::regex_search(str, m, e3)) {
-            throw CorruptFile();
-        } else {
-            throw WrongType();
+//zwraca playliste, ktorej numer jest nastepnym polem rekordu
+Playlist& ChangeRecords::applied(PlayCodec::Reader& in) {
+    uint64_t id = in.number();
+    if (id >= playlists.size()) {
+        throw EncodingError();
+    }
+    return *playlists[id];
+}
+//wykonuje jeden rekord. Pozycje sa sprawdzane, bo to tanie, ale cykle
+//juz nie - byly sprawdzone, zanim zmiana zostala zapisana
+void ChangeRecords::apply_record(const char* body, size_t size) {
+    PlayCodec::Reader in(body, body + size);
+    switch (in.number()) {
+        case PLAYLIST: {
+            if (in.number() != playlists.size()) {
+                throw EncodingError();
+            }
+            names.push_back(in.string());
+            auto playlist = std::make_shared<Playlist>(names.back().c_str());
+            playlist->mode = PlayCodec::get_mode(in);
+            playlist_ids.emplace(playlist.get(), playlists.size());
+            playlists.push_back(std::move(playlist));
+            break;
+        }
+        case ITEM: {
+            if (in.number() != items.size()) {
+                throw EncodingError();
+            }
+            items.push_back(PlayCodec::get_item(in));
+            item_ids.emplace(items.back().get(),
+                             static_cast<uint32_t>(items.size() - 1));
+            break;
         }
+        case INSERT: {
+            Playlist& playlist = applied(in);
+            uint64_t position = in.number();
+            uint64_t count = in.number();
+            if (position > playlist.list_to_play.size()) {
+                throw EncodingError();
+            }
+            std::vector<std::shared_ptr<PlaylistInterface>> new_items;
+            for (uint64_t i = 0; i < count; i++) {
+                uint64_t ref = in.number();
+                uint64_t id = ref >> 1;
+                if ((ref & 1) != 0 && id < playlists.size()) {
+                    new_items.push_back(playlists[id]);
+                } else if ((ref & 1) == 0 && id < items.size()) {
+                    new_items.push_back(items[id]);
+                } else {
+                    throw EncodingError();
+                }
+            }
+            playlist.insert_items(position, new_items);
+            playlist.record({Playlist::Edit::INSERTED, position, count, 0,
+                             {}, {}, nullptr});
+            break;
+        }
+        case ERASE: {
+            Playlist& playlist = applied(in);
+            uint64_t first = in.number();
+            uint64_t last = in.number();
+            if (first > last || last > playlist.list_to_play.size()) {
+                throw EncodingError();
+            }
+            playlist.erase_items(first, last);
+            playlist.record({Playlist::Edit::ERASED, first, last - first, 0,
+                             {}, {}, nullptr});
+            break;
+        }
+        case MOVE: {
+            Playlist& playlist = applied(in);
+            uint64_t first = in.number();
+            uint64_t count = in.number();
+            uint64_t position = in.number();
+            size_t list_size = playlist.list_to_play.size();
+            if (first > list_size || count > list_size - first ||
+                position > list_size - count) {
+                throw EncodingError();
+            }
+            playlist.move_items(first, count, position);
+            playlist.record({Playlist::Edit::MOVED, first, count, position,
+                             {}, {}, nullptr});
+            break;
+        }
+        case REORDER: {
+            Playlist& playlist = applied(in);
+            size_t list_size = playlist.list_to_play.size();
+            std::vector<size_t> permutation(list_size);
+            std::vector<bool> used(list_size, false);
+            for (size_t& position : permutation) {
+                position = in.number();
+                if (position >= list_size || used[position]) {
+                    throw EncodingError();
+                }
+                used[position] = true;
+            }
+            playlist.permute_items(permutation);
+            playlist.record({Playlist::Edit::REORDERED, 0, list_size, 0,
+                             {}, {}, nullptr});
+            break;
+        }
+        case MODE: {
+            Playlist& playlist = applied(in);
+            playlist.mode = PlayCodec::get_mode(in);
+            playlist.invalidate();
+            playlist.record({Playlist::Edit::MODE_CHANGED, 0, 0, 0,
+                             {}, {}, nullptr});
+            break;
+        }
+        default:
+            throw EncodingError();
     }
-    file_type = m.str(0);
-    file_type = file_type.substr(0, file_type.size() - 1);
-    str = m.suffix().str();
-
-    while (std::regex_search(str, m, e2)) {
-        std::string data_type = m.str(0);
-        data_type = data_type.substr(0, data_type.size() - 1);
-        str = m.suffix().str();
-        std::regex_search(str, m, e3);
-        std::string new_data = m.str(0);
-        new_data = new_data.substr(0, new_data.size() - 1);
-
-        metadata.insert(std::make_pair(data_type, new_data));
-
-        str = m.suffix().str();
+    if (!in.done()) {
+        throw EncodingError();
     }
-    if (std::regex_match(str, m, e4)) {
-        lyrics = str;
-    } else {
-        throw WrongLyrics();
+}
+//zwraca numer playlisty. Playliste, ktora nie ma jeszcze numeru,
+//razem z jej nowymi podplaylistami opisuje w out
+uint32_t ChangeRecords::playlist_ref(const std::shared_ptr<Playlist>& playlist,
+                                     std::string& out) {
+    auto it = playlist_ids.find(playlist.get());
+    if (it != playlist_ids.end()) {
+        return it->second;
     }
+    uint32_t id = static_cast<uint32_t>(playlists.size());
+    std::vector<std::shared_ptr<Playlist>> fresh {playlist};
+    playlist_ids.emplace(playlist.get(), id);
+    playlists.push_back(playlist);
+    for (size_t i = 0; i < fresh.size(); i++) {
+        for (auto& pi : fresh[i]->list_to_play) {
+            Playlist* child = Playlist::as_playlist(pi.get());
+            if (child != nullptr && playlist_ids.count(child) == 0) {
+                fresh.push_back(std::static_pointer_cast<Playlist>(pi));
+                playlist_ids.emplace(child,
+                                     static_cast<uint32_t>(playlists.size()));
+                playlists.push_back(fresh.back());
+            }
+        }
+    }
+    snapshot(fresh, out);
+    for (auto& pl : fresh) {
+        started(*pl);
+    }
+    return id;
 }
-//Abstrakcyjna metoda, reprezentujaca klasy, ktore
-//tworza nowe obiekty klas
-class PlayFactory {
+//opisuje w out playlisty, ktore maja juz numery: najpierw wszystkie
+//naglowki, zeby zawartosc mogla sie do nich odwolywac, potem zawartosc
+void ChangeRecords::snapshot
+        (const std::vector<std::shared_ptr<Playlist>>& fresh,
+         std::string& out) {
+    std::string body;
+    for (auto& pl : fresh) {
+        body.clear();
+        PlayCodec::put_number(body, PLAYLIST);
+        PlayCodec::put_number(body, playlist_ids.at(pl.get()));
+        PlayCodec::put_string(body, pl->name);
+        PlayCodec::put_mode(body, pl->mode.get());
+        put(out, body);
+    }
+    for (auto& pl : fresh) {
+        if (!pl->list_to_play.empty()) {
+            put_insert(out, playlist_ids.at(pl.get()), 0,
+                       references(pl->list_to_play.begin(),
+                                  pl->list_to_play.size(), out));
+        }
+    }
+}
+//zwraca odwolanie do elementu: numer i bit, czy to playlista.
+//Utwor, ktory nie ma jeszcze numeru, jest najpierw opisywany w out
+uint64_t ChangeRecords::reference(const std::shared_ptr<PlaylistInterface>& pi,
+                                  std::string& out) {
+    if (Playlist::as_playlist(pi.get()) != nullptr) {
+        uint64_t id = playlist_ref(std::static_pointer_cast<Playlist>(pi), out);
+        return id << 1 | 1;
+    }
+    auto it = item_ids.find(pi.get());
+    if (it != item_ids.end()) {
+        return static_cast<uint64_t>(it->second) << 1;
+    }
+    uint32_t id = static_cast<uint32_t>(items.size());
+    std::string body;
+    PlayCodec::put_number(body, ITEM);
+    PlayCodec::put_number(body, id);
+    PlayCodec::put_item(body, pi.get());
+    put(out, body);
+    items.push_back(pi);
+    item_ids.emplace(pi.get(), id);
+    return static_cast<uint64_t>(id) << 1;
+}
+//zwraca odwolania do count elementow od first
+std::vector<uint64_t> ChangeRecords::references
+        (Playlist::Items::const_iterator first, size_t count,
+         std::string& out) {
+    std::vector<uint64_t> refs;
+    refs.reserve(count);
+    for (size_t i = 0; i < count; i++, first++) {
+        refs.push_back(reference(*first, out));
+    }
+    return refs;
+}
+void ChangeRecords::put_insert(std::string& out, uint32_t id, size_t position,
+                               const std::vector<uint64_t>& refs) {
+    std::string body;
+    PlayCodec::put_number(body, INSERT);
+    PlayCodec::put_number(body, id);
+    PlayCodec::put_number(body, position);
+    PlayCodec::put_number(body, refs.size());
+    for (uint64_t ref : refs) {
+        PlayCodec::put_number(body, ref);
+    }
+    put(out, body);
+}
+void ChangeRecords::put_erase(std::string& out, uint32_t id,
+                              size_t first, size_t last) {
+    std::string body;
+    PlayCodec::put_number(body, ERASE);
+    PlayCodec::put_number(body, id);
+    PlayCodec::put_number(body, first);
+    PlayCodec::put_number(body, last);
+    put(out, body);
+}
+void ChangeRecords::put_move(std::string& out, uint32_t id, size_t first,
+                             size_t count, size_t position) {
+    std::string body;
+    PlayCodec::put_number(body, MOVE);
+    PlayCodec::put_number(body, id);
+    PlayCodec::put_number(body, first);
+    PlayCodec::put_number(body, count);
+    PlayCodec::put_number(body, position);
+    put(out, body);
+}
+void ChangeRecords::put_reorder(std::string& out, uint32_t id,
+                                const std::vector<size_t>& permutation) {
+    std::string body;
+    PlayCodec::put_number(body, REORDER);
+    PlayCodec::put_number(body, id);
+    for (size_t position : permutation) {
+        PlayCodec::put_number(body, position);
+    }
+    put(out, body);
+}
+void ChangeRecords::put_mode(std::string& out, uint32_t id, Mode* mode) {
+    std::string body;
+    PlayCodec::put_number(body, MODE);
+    PlayCodec::put_number(body, id);
+    PlayCodec::put_mode(body, mode);
+    put(out, body);
+}
+//Dziennik zmian sledzonych playlist w pliku, dopisywany na koncu.
+//Kazda zmiana jest zapisana, zanim metoda playlisty sie zakonczy, ale
+//zmiany z wielu watkow czekajace w tym samym czasie sa zapisywane
+//razem, jednym write i jednym fdatasync. Przy otwarciu dziennik jest
+//odtwarzany bez ponownego sprawdzania cykli - byly sprawdzone, zanim
+//zmiana trafila do dziennika. Playlista dostaje w dzienniku numer
+//przy pierwszym sledzeniu.
+//Dziennik dostaje zmiane jako obserwator, juz po jej wykonaniu w pamieci.
+//Gdy zapis sie nie uda, zmiana zostaje w pamieci, pozostali obserwatorzy
+//ja dostaja, a metoda playlisty rzuca DiskError. Od tej chwili kazda
+//zmiana sledzonej playlisty rzuca DiskError i has_failed() zwraca true.
+//Stan w pamieci jest wtedy jedynym poprawnym - compact() zapisuje go
+//od nowa i przywraca dziennik do dzialania.
+//Watki: blokada dziennika chroni tylko jego plik i numery. Zmiana
+//playlisty poprawia tez bez blokad podsumowania jej przodkow, wiec
+//watki moga rownoczesnie zmieniac tylko rozlaczne hierarchie. Watek,
+//ktory zmienia sledzone playlisty, gdy inny moze wolac compact(),
+//trzyma na czas zmian blokade z edit_lock()
+class MutationLog : public ChangeRecords, public PlaylistObserver {
+private:
+    std::string path;
+    int fd;
+    mutable std::mutex lock;
+    std::condition_variable committed;
+    //trzymana wspolnie przez zmieniajacych playlisty, a wylacznie
+    //przez compact
+    std::shared_mutex editing;
+    //rekordy czekajace na zapis
+    std::string pending;
+    //numer ostatniej dopisanej i ostatniej zapisanej na dysk zmiany
+    uint64_t appended;
+    uint64_t durable;
+    bool writing;
+    bool failed;
+    //rozmiar pliku dziennika
+    size_t log_bytes;
+    void put(std::string& out, const std::string& body) override;
+    void started(Playlist& playlist) override;
+    void commit(std::unique_lock<std::mutex>& guard, const std::string& records);
+    static bool write_all(int file, const std::string& data);
 public:
-    virtual std::shared_ptr<Play> create_play(File& file) = 0;
-
-    virtual ~PlayFactory() = default;
+    explicit MutationLog(const std::string& log_path);
+    ~MutationLog() override;
+    uint32_t track(const std::shared_ptr<Playlist>& playlist);
+    std::shared_ptr<Playlist> get(uint32_t id) const;
+    size_t playlist_count() const;
+    size_t size() const;
+    bool has_failed() const;
+    std::shared_lock<std::shared_mutex> edit_lock();
+    void compact();
+    void inserted(Playlist& playlist, size_t position,
+                  Playlist::Items::const_iterator first, size_t count) override;
+    void erased(Playlist& playlist, size_t first, size_t last) override;
+    void moved(Playlist& playlist, size_t first, size_t count,
+               size_t position) override;
+    void reordered(Playlist& playlist,
+                   const std::vector<size_t>& permutation) override;
+    void mode_changed(Playlist& playlist,
+                      const std::shared_ptr<Mode>& mode) override;
 };
-//Twory obiekt klasy Song
-class AudioFactory : public PlayFactory {
+//otwiera dziennik, tworzac go, jesli nie istnieje, i odtwarza zapisane
+//w nim playlisty. Urwany ostatni zapis (np. po awarii) jest odcinany
+MutationLog::MutationLog(const std::string& log_path) : path(log_path) {
+    appended = 0;
+    durable = 0;
+    writing = false;
+    failed = false;
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        throw DiskError();
+    }
+    try {
+        struct stat st {};
+        if (::fstat(fd, &st) != 0) {
+            throw DiskError();
+        }
+        std::string contents(static_cast<size_t>(st.st_size), '\0');
+        size_t done = 0;
+        while (done < contents.size()) {
+            ssize_t got = ::pread(fd, &contents[done], contents.size() - done,
+                                  static_cast<off_t>(done));
+            if (got <= 0) {
+                throw DiskError();
+            }
+            done += static_cast<size_t>(got);
+        }
+        const char* pos = contents.data();
+        const char* end = pos + contents.size();
+        const char* body;
+        size_t body_size;
+        while (PlayCodec::get_record(pos, end, body, body_size)) {
+            apply_record(body, body_size);
+        }
+        log_bytes = static_cast<size_t>(pos - contents.data());
+        if (log_bytes < contents.size() &&
+            ::ftruncate(fd, static_cast<off_t>(log_bytes)) != 0) {
+            throw DiskError();
+        }
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    for (auto& playlist : playlists) {
+        playlist->addObserver(this);
+    }
+}
+//wypisuje sie z playlist i zamyka plik
+MutationLog::~MutationLog() {
+    for (auto& playlist : playlists) {
+        playlist->removeObserver(this);
+    }
+    ::close(fd);
+}
+//rekord w dzienniku ma dlugosc i sume kontrolna
+void MutationLog::put(std::string& out, const std::string& body) {
+    PlayCodec::put_record(out, body);
+}
+void MutationLog::started(Playlist& playlist) {
+    playlist.addObserver(this);
+}
+//zapisuje caly bufor, ponawiajac przerwane zapisy
+bool MutationLog::write_all(int file, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t written = ::write(file, data.data() + done, data.size() - done);
+        if (written < 0) {
+            return false;
+        }
+        done += static_cast<size_t>(written);
+    }
+    return true;
+}
+//dopisuje rekordy i czeka, az trafia na dysk. Pierwszy czekajacy watek
+//zapisuje wszystko, co sie do tej pory zebralo, a pozostale czekaja na
+//niego; rekordy dopisane w tym czasie pojda w nastepnym zapisie
+void MutationLog::commit(std::unique_lock<std::mutex>& guard,
+                         const std::string& records) {
+    if (failed) {
+        throw DiskError();
+    }
+    pending.append(records);
+    uint64_t ticket = ++appended;
+    while (durable < ticket) {
+        if (failed) {
+            throw DiskError();
+        }
+        if (writing) {
+            committed.wait(guard);
+            continue;
+        }
+        writing = true;
+        std::string batch;
+        batch.swap(pending);
+        uint64_t last = appended;
+        guard.unlock();
+        bool ok = write_all(fd, batch) && ::fdatasync(fd) == 0;
+        guard.lock();
+        writing = false;
+        if (ok) {
+            durable = last;
+            log_bytes += batch.size();
+        } else {
+            failed = true;
+        }
+        committed.notify_all();
+    }
+}
+//zaczyna sledzic playliste i jej podplaylisty; zwraca numer playlisty
+uint32_t MutationLog::track(const std::shared_ptr<Playlist>& playlist) {
+    std::unique_lock<std::mutex> guard(lock);
+    std::string out;
+    uint32_t id = playlist_ref(playlist, out);
+    if (!out.empty()) {
+        commit(guard, out);
+    }
+    return id;
+}
+//zwraca sledzona playliste o danym numerze
+std::shared_ptr<Playlist> MutationLog::get(uint32_t id) const {
+    std::lock_guard<std::mutex> guard(lock);
+    if (id >= playlists.size()) {
+        throw WrongPosition();
+    }
+    return playlists[id];
+}
+size_t MutationLog::playlist_count() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return playlists.size();
+}
+//rozmiar dziennika na dysku w bajtach
+size_t MutationLog::size() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return log_bytes;
+}
+//czy ktorys zapis sie nie udal, wiec dziennik nie nadaza za pamiecia
+bool MutationLog::has_failed() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return failed;
+}
+//blokada na czas zmian sledzonych playlist; compact czeka, az wszystkie
+//zostana zwolnione, wiec zadna zmiana nie trafi i do zapisanego stanu,
+//i do dziennika po nim
+std::shared_lock<std::shared_mutex> MutationLog::edit_lock() {
+    return std::shared_lock<std::shared_mutex>(editing);
+}
+//zastepuje dziennik zapisem obecnego stanu sledzonych playlist, zeby
+//nie rosl bez konca; po nieudanym zapisie przywraca tez dziennik do
+//dzialania. Numery playlist sie nie zmieniaja. Przez caly czas trzyma
+//blokade dziennika i wylacznie blokade zmian, wiec nie wolno go wolac
+//z watku, ktory trzyma edit_lock()
+void MutationLog::compact() {
+    std::unique_lock<std::shared_mutex> exclusive(editing);
+    std::unique_lock<std::mutex> guard(lock);
+    committed.wait(guard, [this] { return !writing; });
+    items.clear();
+    item_ids.clear();
+    std::string out;
+    snapshot(playlists, out);
+    std::string temporary = path + ".compact";
+    int file = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = file >= 0;
+    if (ok) {
+        ok = write_all(file, out) && ::fdatasync(file) == 0;
+        ok = ::close(file) == 0 && ok;
+    }
+    ok = ok && std::rename(temporary.c_str(), path.c_str()) == 0;
+    if (ok) {
+        size_t slash = path.find_last_of('/');
+        std::string directory = slash == std::string::npos ?
+                                "." : path.substr(0, slash + 1);
+        int dir = ::open(directory.c_str(), O_RDONLY);
+        if (dir >= 0) {
+            ::fsync(dir);
+            ::close(dir);
+        }
+        ::close(fd);
+        fd = ::open(path.c_str(), O_RDWR | O_APPEND);
+        ok = fd >= 0;
+    }
+    if (!ok) {
+        failed = true;
+        committed.notify_all();
+        throw DiskError();
+    }
+    //zmiany czekajace na zapis sa juz w nowym dzienniku
+    pending.clear();
+    failed = false;
+    durable = appended;
+    log_bytes = out.size();
+    committed.notify_all();
+}
+void MutationLog::inserted(Playlist& playlist, size_t position,
+                           Playlist::Items::const_iterator first,
+                           size_t count) {
+    std::unique_lock<std::mutex> guard(lock);
+    std::string out;
+    uint32_t id = playlist_ids.at(&playlist);
+    put_insert(out, id, position, references(first, count, out));
+    commit(guard, out);
+}
+void MutationLog::erased(Playlist& playlist, size_t first, size_t last) {
+    std::unique_lock<std::mutex> guard(lock);
+    std::string out;
+    put_erase(out, playlist_ids.at(&playlist), first, last);
+    commit(guard, out);
+}
+void MutationLog::moved(Playlist& playlist, size_t first, size_t count,
+                        size_t position) {
+    std::unique_lock<std::mutex> guard(lock);
+    std::string out;
+    put_move(out, playlist_ids.at(&playlist), first, count, position);
+    commit(guard, out);
+}
+void MutationLog::reordered(Playlist& playlist,
+                            const std::vector<size_t>& permutation) {
+    std::unique_lock<std::mutex> guard(lock);
+    std::string out;
+    put_reorder(out, playlist_ids.at(&playlist), permutation);
+    commit(guard, out);
+}
+void MutationLog::mode_changed(Playlist& playlist,
+                               const std::shared_ptr<Mode>& mode) {
+    std::unique_lock<std::mutex> guard(lock);
+    std::string out;
+    put_mode(out, playlist_ids.at(&playlist), mode.get());
+    commit(guard, out);
+}
+//Strumien zmian playlisty dla jej kopii w innych procesach. Pierwsza
+//ramka opisuje cala playliste razem z podplaylistami, kolejne tylko
+//zmiany: pozycje i numery utworow, a tresc utworu tylko przy jego
+//pierwszym uzyciu. Zmiany sa zbierane do flush, ktore wydaje je jako
+//jedna ramke z kolejnym numerem; sasiednie zmiany tej samej playlisty,
+//ktore sie skladaja (wstawienia obok siebie, usuniecia obok siebie,
+//usuniecie czesci dopiero co wstawionych elementow, kolejne zmiany
+//sposobu odtwarzania), trafiaja do ramki jako jedna
+class ChangeFeed : public ChangeRecords, public PlaylistObserver {
+private:
+    //ostatnia zmiana, do ktorej mozna jeszcze dolaczyc nastepna
+    struct Pending {
+        RecordKind kind;
+        uint32_t playlist;
+        size_t first;
+        size_t last;
+        std::vector<uint64_t> refs;
+        std::shared_ptr<Mode> mode;
+    };
+    //rekordy gotowe do wyslania w nastepnej ramce
+    std::string batch;
+    std::unique_ptr<Pending> pending;
+    uint64_t sequence;
+    void put(std::string& out, const std::string& body) override;
+    void started(Playlist& playlist) override;
+    void close_pending();
+    bool merge_erase(uint32_t id, size_t first, size_t last);
 public:
-    AudioFactory() = default;
-    std::shared_ptr<Play> create_play(File& file) override ;
+    explicit ChangeFeed(const std::shared_ptr<Playlist>& playlist);
+    ~ChangeFeed() override;
+    std::string flush();
+    void flush(int fd);
+    uint64_t get_sequence() const {
+        return sequence;
+    }
+    void inserted(Playlist& playlist, size_t position,
+                  Playlist::Items::const_iterator first, size_t count) override;
+    void erased(Playlist& playlist, size_t first, size_t last) override;
+    void moved(Playlist& playlist, size_t first, size_t count,
+               size_t position) override;
+    void reordered(Playlist& playlist,
+                   const std::vector<size_t>& permutation) override;
+    void mode_changed(Playlist& playlist,
+                      const std::shared_ptr<Mode>& mode) override;
 };
-//metoda tworzaca nowy obiekt klasy Song
-std::shared_ptr<Play> AudioFactory::create_play(File& file) {
-    std::shared_ptr<Play> play = std::make_shared<Song>
-            (file.get_metadata(), file.get_lyrics());
-    return play;
+//zaczyna sledzic playliste; jej opis trafi do pierwszej ramki
+ChangeFeed::ChangeFeed(const std::shared_ptr<Playlist>& playlist) {
+    sequence = 0;
+    playlist_ref(playlist, batch);
 }
-//klasa tworzaca nowy obiekt klasy Movie
-class MovieFactory : public PlayFactory {
+ChangeFeed::~ChangeFeed() {
+    for (auto& playlist : playlists) {
+        playlist->removeObserver(this);
+    }
+}
+//rekord w ramce ma tylko dlugosc; ramka ma sume kontrolna calosci
+void ChangeFeed::put(std::string& out, const std::string& body) {
+    PlayCodec::put_number(out, body.size());
+    out.append(body);
+}
+void ChangeFeed::started(Playlist& playlist) {
+    playlist.addObserver(this);
+}
+//dopisuje ostatnia zmiane do ramki
+void ChangeFeed::close_pending() {
+    if (!pending) {
+        return;
+    }
+    switch (pending->kind) {
+        case INSERT:
+            put_insert(batch, pending->playlist, pending->first, pending->refs);
+            break;
+        case ERASE:
+            put_erase(batch, pending->playlist, pending->first, pending->last);
+            break;
+        default:
+            put_mode(batch, pending->playlist, pending->mode.get());
+            break;
+    }
+    pending.reset();
+}
+//wydaje zebrane zmiany jako jedna ramke: numer ramki, a po nim rekordy;
+//zwraca pusty napis, gdy od poprzedniej ramki nic sie nie zmienilo
+std::string ChangeFeed::flush() {
+    close_pending();
+    if (batch.empty()) {
+        return {};
+    }
+    std::string body;
+    PlayCodec::put_number(body, sequence++);
+    body.append(batch);
+    batch.clear();
+    std::string frame;
+    PlayCodec::put_record(frame, body);
+    return frame;
+}
+//wysyla ramke do deskryptora, np. potoku lub gniazda
+void ChangeFeed::flush(int fd) {
+    std::string frame = flush();
+    size_t done = 0;
+    while (done < frame.size()) {
+        ssize_t written = ::write(fd, frame.data() + done, frame.size() - done);
+        if (written < 0) {
+            throw DiskError();
+        }
+        done += static_cast<size_t>(written);
+    }
+}
+//wstawienie obok lub wewnatrz poprzedniego wstawienia jest z nim laczone
+void ChangeFeed::inserted(Playlist& playlist, size_t position,
+                          Playlist::Items::const_iterator first,
+                          size_t count) {
+    uint32_t id = playlist_ids.at(&playlist);
+    std::vector<uint64_t> refs = references(first, count, batch);
+    if (pending && pending->kind == INSERT && pending->playlist == id &&
+        position >= pending->first &&
+        position <= pending->first + pending->refs.size()) {
+        std::vector<uint64_t>& merged = pending->refs;
+        merged.insert(merged.begin() + (position - pending->first),
+                      refs.begin(), refs.end());
+        return;
+    }
+    close_pending();
+    pending.reset(new Pending {INSERT, id, position, 0, std::move(refs),
+                               nullptr});
+}
+//laczy usuniecie z poprzednia zmiana; zwraca false, gdy sie nie da
+bool ChangeFeed::merge_erase(uint32_t id, size_t first, size_t last) {
+    if (!pending || pending->playlist != id) {
+        return false;
+    }
+    if (pending->kind == INSERT) {
+        //usuniecie samych dopiero co wstawionych elementow
+        size_t begin = pending->first;
+        if (first < begin || last > begin + pending->refs.size()) {
+            return false;
+        }
+        std::vector<uint64_t>& refs = pending->refs;
+        refs.erase(refs.begin() + (first - begin), refs.begin() + (last - begin));
+        if (refs.empty()) {
+            pending.reset();
+        }
+        return true;
+    }
+    if (pending->kind == ERASE) {
+        //kolejne usuniecie z tego samego miejsca lub tuz przed nim
+        if (first == pending->first) {
+            pending->last += last - first;
+            return true;
+        }
+        if (last == pending->first) {
+            pending->first = first;
+            return true;
+        }
+    }
+    return false;
+}
+void ChangeFeed::erased(Playlist& playlist, size_t first, size_t last) {
+    uint32_t id = playlist_ids.at(&playlist);
+    if (merge_erase(id, first, last)) {
+        return;
+    }
+    close_pending();
+    pending.reset(new Pending {ERASE, id, first, last, {}, nullptr});
+}
+void ChangeFeed::moved(Playlist& playlist, size_t first, size_t count,
+                       size_t position) {
+    close_pending();
+    put_move(batch, playlist_ids.at(&playlist), first, count, position);
+}
+void ChangeFeed::reordered(Playlist& playlist,
+                           const std::vector<size_t>& permutation) {
+    close_pending();
+    put_reorder(batch, playlist_ids.at(&playlist), permutation);
+}
+//z kolejnych zmian sposobu odtwarzania wysylana jest tylko ostatnia
+void ChangeFeed::mode_changed(Playlist& playlist,
+                              const std::shared_ptr<Mode>& mode) {
+    uint32_t id = playlist_ids.at(&playlist);
+    if (pending && pending->kind == MODE && pending->playlist == id) {
+        pending->mode = mode;
+        return;
+    }
+    close_pending();
+    pending.reset(new Pending {MODE, id, 0, 0, {}, mode});
+}
+//Kopia playlisty odtwarzana z ramek ChangeFeed, po kolei i bez
+//ponownego sprawdzania cykli. Ramka z nieoczekiwanym numerem (zgubiona
+//lub powtorzona) jest odrzucana wyjatkiem, bo kopia bylaby niepoprawna
+class ChangeApplier : public ChangeRecords {
+private:
+    uint64_t sequence;
+    void put(std::string& out, const std::string& body) override;
+    void started(Playlist& playlist) override;
 public:
-    MovieFactory() = default;
-    std::shared_ptr<Play> create_play(File& file) override ;
+    ChangeApplier() {
+        sequence = 0;
+    }
+    size_t apply(const char* data, size_t size);
+    bool apply(int fd);
+    //kopia sledzonej playlisty; jej podplaylisty maja kolejne numery
+    std::shared_ptr<Playlist> get(uint32_t id = 0) const;
+    uint64_t get_sequence() const {
+        return sequence;
+    }
 };
-//metoda tworzaca nowy obiekt klasy Movie
-std::shared_ptr<Play> MovieFactory::create_play(File &file) {
-    std::shared_ptr<Play> play =  std::make_shared<Movie>
-                                  (file.get_metadata(), file.get_lyrics());
-    return play;
+void ChangeApplier::put(std::string& out, const std::string& body) {
+    (void)out;
+    (void)body;
 }
-//Klasa reprezentujaca Player
-class Player {
+void ChangeApplier::started(Playlist& playlist) {
+    (void)playlist;
+}
+//stosuje ramke z poczatku danych; zwraca jej dlugosc albo 0, gdy dane
+//nie zawieraja jeszcze calej ramki
+size_t ChangeApplier::apply(const char* data, size_t size) {
+    const char* pos = data;
+    const char* body;
+    size_t body_size;
+    if (!PlayCodec::get_record(pos, data + size, body, body_size)) {
+        if (size >= PlayCodec::HEADER_BYTES) {
+            uint32_t length;
+            std::memcpy(&length, data, sizeof(length));
+            if (length <= size - PlayCodec::HEADER_BYTES) {
+                throw EncodingError();
+            }
+        }
+        return 0;
+    }
+    PlayCodec::Reader in(body, body + body_size);
+    if (in.number() != sequence) {
+        throw EncodingError();
+    }
+    const char* record = body + (body_size - in.remaining());
+    const char* end = body + body_size;
+    while (record != end) {
+        PlayCodec::Reader header(record, end);
+        uint64_t length = header.number();
+        record = end - header.remaining();
+        if (length > static_cast<uint64_t>(end - record)) {
+            throw EncodingError();
+        }
+        apply_record(record, length);
+        record += length;
+    }
+    sequence++;
+    return static_cast<size_t>(pos - data);
+}
+//czyta z deskryptora i stosuje jedna ramke; zwraca false, gdy strumien
+//sie skonczyl przed poczatkiem ramki
+bool ChangeApplier::apply(int fd) {
+    std::string frame(PlayCodec::HEADER_BYTES, '\0');
+    size_t done = 0;
+    while (true) {
+        size_t wanted = frame.size();
+        if (done == PlayCodec::HEADER_BYTES && wanted == done) {
+            uint32_t length;
+            std::memcpy(&length, frame.data(), sizeof(length));
+            frame.resize(PlayCodec::HEADER_BYTES + length);
+            wanted = frame.size();
+        }
+        if (done == wanted) {
+            break;
+        }
+        ssize_t got = ::read(fd, &frame[done], wanted - done);
+        if (got == 0 && done == 0) {
+            return false;
+        }
+        if (got <= 0) {
+            throw DiskError();
+        }
+        done += static_cast<size_t>(got);
+    }
+    if (apply(frame.data(), frame.size()) == 0) {
+        throw EncodingError();
+    }
+    return true;
+}
+std::shared_ptr<Playlist> ChangeApplier::get(uint32_t id) const {
+    if (id >= playlists.size()) {
+        throw WrongPosition();
+    }
+    return playlists[id];
+}
+//Asynchroniczne odtwarzanie wielu playlist naraz na wirtualnym zegarze.
+//Kazda sesja to wznawialny kursor po skompilowanym planie: wykonuje
+//jeden krok i oddaje sterowanie, a harmonogram wznawia ja, gdy na
+//zegarze minie czas trwania odtworzonego elementu. Sesje, ktore maja
+//zostac wznowione w tej samej chwili, sa rozdzielane miedzy watki puli
+class PlaybackScheduler {
 public:
-    static std::shared_ptr<Play> openFile(File file);
-    static std::shared_ptr<Playlist> createPlaylist(const char*);
+    using Duration = std::function<uint64_t(PlaylistInterface&)>;
+private:
+    //stan jednej sesji odtwarzania
+    struct Session {
+        std::shared_ptr<Playlist> playlist;
+        std::shared_ptr<Mode> mode;
+        std::shared_ptr<const PlayPlan> plan;
+        size_t step;
+        uint64_t resume_time;
+        uint64_t remaining;
+        uint64_t generation;
+        bool paused;
+        bool finished;
+    };
+    //wpis kolejki: sesja do wznowienia o danym czasie
+    struct Wakeup {
+        uint64_t time;
+        size_t session;
+        uint64_t generation;
+        bool operator>(const Wakeup& other) const {
+            return time > other.time ||
+                   (time == other.time && session > other.session);
+        }
+    };
+    std::vector<Session> sessions;
+    std::priority_queue<Wakeup, std::vector<Wakeup>,
+                        std::greater<Wakeup>> wakeups;
+    uint64_t now;
+    Duration duration;
+    std::mutex lock;
+    std::mutex output_lock;
+    //pula watkow wykonujaca kroki sesji z jednej chwili
+    std::vector<std::thread> workers;
+    std::mutex pool_lock;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+    std::vector<size_t> batch;
+    std::atomic<size_t> next_in_batch;
+    size_t round;
+    size_t busy;
+    bool stopping;
+    void worker_loop();
+    void run_batch();
+    void step(Session& session);
+    void schedule(size_t id);
+    Session& get_session(size_t id);
+public:
+    //workers to liczba dodatkowych watkow; przy 0 wszystko wykonuje
+    //watek wywolujacy advance, w ustalonej kolejnosci
+    explicit PlaybackScheduler(size_t workers_count = 0,
+                               Duration item_duration = nullptr);
+    PlaybackScheduler(const PlaybackScheduler&) = delete;
+    PlaybackScheduler& operator=(const PlaybackScheduler&) = delete;
+    ~PlaybackScheduler();
+    size_t start(const std::shared_ptr<Playlist>& playlist);
+    size_t start(const std::shared_ptr<Playlist>& playlist,
+                 std::shared_ptr<Mode> mode);
+    void pause(size_t id);
+    void resume(size_t id);
+    void skip(size_t id);
+    void setMode(size_t id, std::shared_ptr<Mode> mode);
+    bool is_finished(size_t id);
+    uint64_t get_time();
+    void advance(uint64_t ticks);
 };
-//metoda, ktora zleca stworznie nowego obiektu klasy Play
-std::shared_ptr<Play> Player::openFile(File file) {
-    std::shared_ptr<Play> play = nullptr;
-    if (file.get_file_type() == "audio") {
-        AudioFactory af = AudioFactory();
-        play = af.create_play(file);
-
-    } else if (file.get_file_type() == "video") {
-        MovieFactory mf = MovieFactory();
-        play = mf.create_play(file);
+//tworzy harmonogram; domyslnie kazdy element trwa jedna jednostke czasu
+PlaybackScheduler::PlaybackScheduler(size_t workers_count,
+                                     Duration item_duration) {
+    now = 0;
+    duration = std::move(item_duration);
+    if (!duration) {
+        duration = [](PlaylistInterface&) { return uint64_t(1); };
+    }
+    next_in_batch = 0;
+    round = 0;
+    busy = 0;
+    stopping = false;
+    for (size_t i = 0; i < workers_count; i++) {
+        workers.emplace_back(&PlaybackScheduler::worker_loop, this);
     }
-    return play;
 }
-//metoda tworzaca nowa Playliste
-std::shared_ptr<Playlist> Player::createPlaylist(const char *name) {
-    auto playlist = std::make_shared<Playlist>(name);
-    return playlist;
+//zatrzymuje watki puli
+PlaybackScheduler::~PlaybackScheduler() {
+    {
+        std::lock_guard<std::mutex> guard(pool_lock);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+//petla watku puli: czeka na kolejna porcje sesji i wykonuje jej kroki
+void PlaybackScheduler::worker_loop() {
+    size_t seen_round = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(pool_lock);
+            work_ready.wait(guard, [&] {
+                return stopping || round != seen_round;
+            });
+            if (stopping) {
+                return;
+            }
+            seen_round = round;
+        }
+        size_t i;
+        while ((i = next_in_batch++) < batch.size()) {
+            step(sessions[batch[i]]);
+        }
+        {
+            std::lock_guard<std::mutex> guard(pool_lock);
+            busy--;
+        }
+        work_done.notify_one();
+    }
+}
+//wykonuje kroki wszystkich sesji z porcji, razem z watkami puli
+void PlaybackScheduler::run_batch() {
+    next_in_batch = 0;
+    if (!workers.empty() && batch.size() > 1) {
+        {
+            std::lock_guard<std::mutex> guard(pool_lock);
+            busy = workers.size();
+            round++;
+        }
+        work_ready.notify_all();
+    }
+    size_t i;
+    while ((i = next_in_batch++) < batch.size()) {
+        step(sessions[batch[i]]);
+    }
+    std::unique_lock<std::mutex> guard(pool_lock);
+    work_done.wait(guard, [&] { return busy == 0; });
+}
+//odtwarza kolejny krok sesji: naglowki playlist nie trwaja,
+//wiec sa odtwarzane razem z nastepujacym po nich elementem
+void PlaybackScheduler::step(Session& session) {
+    const std::vector<PlayPlan::Step>& steps = session.plan->get_steps();
+    while (session.step < steps.size()) {
+        const PlayPlan::Step& current = steps[session.step++];
+        std::lock_guard<std::mutex> guard(output_lock);
+        if (current.item == nullptr) {
+            std::cout<<"Playlist ["<<current.playlist_name<<"]"<<std::endl;
+        } else {
+            current.item->play();
+            session.resume_time = now + duration(*current.item);
+            return;
+        }
+    }
+    session.finished = true;
+    session.plan.reset();
+}
+//wstawia sesje do kolejki na jej czas wznowienia
+void PlaybackScheduler::schedule(size_t id) {
+    Session& session = sessions[id];
+    session.generation++;
+    wakeups.push({session.resume_time, id, session.generation});
+}
+//zwraca sesje o danym numerze lub rzuca wyjatek
+PlaybackScheduler::Session& PlaybackScheduler::get_session(size_t id) {
+    if (id >= sessions.size()) {
+        throw WrongPosition();
+    }
+    return sessions[id];
+}
+//zaczyna odtwarzanie playlisty w jej wlasnym sposobie odtwarzania
+size_t PlaybackScheduler::start(const std::shared_ptr<Playlist>& playlist) {
+    std::lock_guard<std::mutex> guard(lock);
+    sessions.push_back({playlist, nullptr, playlist->compile(),
+                        0, now, 0, 0, false, false});
+    schedule(sessions.size() - 1);
+    return sessions.size() - 1;
+}
+//zaczyna odtwarzanie playlisty w podanym sposobie odtwarzania
+size_t PlaybackScheduler::start(const std::shared_ptr<Playlist>& playlist,
+                                std::shared_ptr<Mode> mode) {
+    std::lock_guard<std::mutex> guard(lock);
+    std::shared_ptr<const PlayPlan> plan = playlist->compile(*mode);
+    sessions.push_back({playlist, std::move(mode), std::move(plan),
+                        0, now, 0, 0, false, false});
+    schedule(sessions.size() - 1);
+    return sessions.size() - 1;
+}
+//wstrzymuje sesje, zapamietujac, ile zostalo z biezacego elementu
+void PlaybackScheduler::pause(size_t id) {
+    std::lock_guard<std::mutex> guard(lock);
+    Session& session = get_session(id);
+    if (session.paused || session.finished) {
+        return;
+    }
+    session.paused = true;
+    session.remaining = session.resume_time - now;
+    session.generation++;
+}
+//wznawia wstrzymana sesje
+void PlaybackScheduler::resume(size_t id) {
+    std::lock_guard<std::mutex> guard(lock);
+    Session& session = get_session(id);
+    if (!session.paused) {
+        return;
+    }
+    session.paused = false;
+    session.resume_time = now + session.remaining;
+    schedule(id);
+}
+//konczy biezacy element; nastepny zostanie odtworzony
+//przy najblizszym advance
+void PlaybackScheduler::skip(size_t id) {
+    std::lock_guard<std::mutex> guard(lock);
+    Session& session = get_session(id);
+    if (session.finished) {
+        return;
+    }
+    session.resume_time = now;
+    session.remaining = 0;
+    if (!session.paused) {
+        schedule(id);
+    }
+}
+//zmienia sposob odtwarzania sesji; odtwarzanie zaczyna sie od poczatku
+//planu ulozonego w nowy sposob
+void PlaybackScheduler::setMode(size_t id, std::shared_ptr<Mode> mode) {
+    std::lock_guard<std::mutex> guard(lock);
+    Session& session = get_session(id);
+    session.plan = session.playlist->compile(*mode);
+    session.mode = std::move(mode);
+    session.step = 0;
+    session.finished = false;
+    session.resume_time = now;
+    session.remaining = 0;
+    if (!session.paused) {
+        schedule(id);
+    }
+}
+//sprawdza, czy sesja odtworzyla juz caly plan
+bool PlaybackScheduler::is_finished(size_t id) {
+    std::lock_guard<std::mutex> guard(lock);
+    return get_session(id).finished;
+}
+//zwraca czas wirtualnego zegara
+uint64_t PlaybackScheduler::get_time() {
+    std::lock_guard<std::mutex> guard(lock);
+    return now;
+}
+//przesuwa wirtualny zegar o ticks, wznawiajac po kolei wszystkie
+//sesje, ktorych czas wznowienia w tym czasie mija
+void PlaybackScheduler::advance(uint64_t ticks) {
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t end = now + ticks;
+    while (!wakeups.empty() && wakeups.top().time <= end) {
+        now = wakeups.top().time;
+        batch.clear();
+        while (!wakeups.empty() && wakeups.top().time == now) {
+            Wakeup wakeup = wakeups.top();
+            wakeups.pop();
+            Session& session = sessions[wakeup.session];
+            if (wakeup.generation == session.generation && !session.paused
+                && !session.finished) {
+                batch.push_back(wakeup.session);
+            }
+        }
+        run_batch();
+        for (size_t id : batch) {
+            if (!sessions[id].finished) {
+                schedule(id);
+            }
+        }
+    }
+    now = end;
 }
 
 #endif //JNP6_LIB_PLAYLIST_H
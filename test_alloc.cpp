@@ -0,0 +1,83 @@
+//Sprawdza, ile alokacji kosztuje otwarcie jednego pliku. Przed
+//przenoszeniem danych z File do Song i Movie bylo to ok. 1350 alokacji
+//na piosenke. Teraz kazda dluga wartosc pola jest alokowana raz, a tekst
+//przejmuje bufor opisu, wiec koszt opisu to koszt opisu o tych samych
+//polach z krotkimi wartosciami plus jedna alokacja na kazda dluga
+//wartosc pola.
+//Kompilacja: g++ -std=c++17 -O2 -pthread test_alloc.cpp -o test_alloc
+#include <cstdlib>
+#include <new>
+
+static size_t allocations = 0;
+static bool counting = false;
+
+[[gnu::noinline]] void* operator new(size_t size) {
+    if (counting) {
+        allocations++;
+    }
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+[[gnu::noinline]] void operator delete(void* p) noexcept {
+    std::free(p);
+}
+[[gnu::noinline]] void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+#include "lib_playlist.h"
+
+//zlicza alokacje przy otwieraniu pliku o podanym opisie
+size_t count_allocations(const char* descriptor) {
+    allocations = 0;
+    counting = true;
+    auto play = Player::openFile(File(descriptor));
+    counting = false;
+    return allocations;
+}
+
+//opis pliku, opis z tymi samymi polami, ale krotkimi wartosciami
+//(jego koszt to parsowanie i kopia opisu), oraz wartosci pol opisu
+//bez tekstu
+struct Case {
+    const char* descriptor;
+    const char* reference;
+    std::vector<std::string> values;
+};
+
+int main() {
+    const std::vector<Case> cases {
+        {"audio|artist:Louis Armstrong|title:What a Wonderful World|"
+         "I see trees of green, red roses too...",
+         "audio|artist:a|title:b|c",
+         {"Louis Armstrong", "What a Wonderful World"}},
+        {"video|title:Cabaret|year:1972|Qvfcynlvat Pnonerg",
+         "video|title:a|year:1|b",
+         {"Cabaret", "1972"}},
+    };
+    //pierwsze otwarcie kompiluje statyczne wyrazenia regularne
+    Player::openFile(File(cases[0].reference));
+    const size_t inline_capacity = std::string().capacity();
+
+    bool ok = true;
+    for (const Case& c : cases) {
+        //kazda wartosc, ktora nie miesci sie w samym napisie, powinna
+        //byc zaalokowana dokladnie raz, a potem juz tylko przenoszona
+        size_t expected = count_allocations(c.reference);
+        for (const std::string& value : c.values) {
+            if (value.size() > inline_capacity) {
+                expected++;
+            }
+        }
+        size_t count = count_allocations(c.descriptor);
+        std::cout << count << " allocations: " << c.descriptor << std::endl;
+        if (count != expected) {
+            std::cout << "expected " << expected << " allocations" << std::endl;
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+//Sprawdza, ze operacje na lancuchu 100 000 zagniezdzonych playlist
+//nie sa rekurencyjne: budowa, odrzucenie cyklu, stats, play, compile,
+//clone i usuniecie dzialaja na domyslnym stosie.
+//Kompilacja: g++ -std=c++17 -O2 -pthread test_deep.cpp -o test_deep
+#include "lib_playlist.h"
+#include <sstream>
+
+const size_t DEPTH = 100000;
+
+bool check(bool condition, const char* what) {
+    std::cout << (condition ? "ok: " : "FAILED: ") << what << std::endl;
+    return condition;
+}
+
+int main() {
+    bool ok = true;
+    auto song = Player::openFile(File("audio|artist:Louis Armstrong|"
+                                      "title:What a Wonderful World|"
+                                      "I see trees of green, red roses too..."));
+    //chain[0] zawiera chain[1], ..., chain[DEPTH - 1] zawiera utwor
+    auto root = Player::createPlaylist("root");
+    std::weak_ptr<Playlist> deepest;
+    {
+        std::shared_ptr<Playlist> bottom = Player::createPlaylist("bottom");
+        bottom->add(song);
+        deepest = bottom;
+        for (size_t level = 2; level < DEPTH; level++) {
+            auto upper = Player::createPlaylist("level");
+            upper->add(bottom);
+            bottom = upper;
+        }
+        root->add(bottom);
+    }
+
+    PlayStats stats = root->stats();
+    ok &= check(stats.depth == DEPTH && stats.songs == 1 &&
+                stats.playlists == DEPTH, "stats");
+
+    bool rejected = false;
+    try {
+        deepest.lock()->add(root);
+    } catch (NoCyclesAllowed&) {
+        rejected = true;
+    }
+    ok &= check(rejected, "cycle rejected");
+
+    std::ostringstream played;
+    std::streambuf* old_buffer = std::cout.rdbuf(played.rdbuf());
+    root->play();
+    std::cout.rdbuf(old_buffer);
+    std::string output = played.str();
+    ok &= check(std::count(output.begin(), output.end(), '\n') ==
+                static_cast<std::ptrdiff_t>(DEPTH + 1), "play");
+
+    auto plan = root->compile();
+    ok &= check(plan->size() == DEPTH + 1, "compile");
+
+    auto copy = root->clone("copy");
+    ok &= check(copy->stats() == stats, "clone");
+
+    plan.reset();
+    copy.reset();
+    root.reset();
+    ok &= check(deepest.expired(), "teardown");
+    return ok ? 0 : 1;
+}
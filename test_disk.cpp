@@ -0,0 +1,109 @@
+//Sprawdza odtwarzanie DiskPlaylist z 2 000 000 elementow przy pamieci
+//stron 1 MB: kazdy element jest odtwarzany dokladnie raz po kolei
+//i losowo, losowe odtwarzanie nie jest duzo wolniejsze niz po kolei
+//i nie zajmuje wiecej stron, a SpreadMode jest odrzucany.
+//Kompilacja: g++ -std=c++17 -O2 -pthread test_disk.cpp -o test_disk
+#include "lib_playlist.h"
+#include <chrono>
+
+const size_t ENTRIES = 2000000;
+const size_t SONGS = 1000;
+const size_t CACHE_BYTES = 1 << 20;
+
+bool check(bool condition, const char* what) {
+    std::cout << (condition ? "ok: " : "FAILED: ") << what << std::endl;
+    return condition;
+}
+
+//liczy, ile razy wypisano kazdy wiersz
+class LineCounter : public std::streambuf {
+private:
+    std::string line;
+public:
+    std::unordered_map<std::string, size_t> counts;
+protected:
+    int overflow(int c) override {
+        if (c == '\n') {
+            counts[line]++;
+            line.clear();
+        } else if (c != EOF) {
+            line.push_back(static_cast<char>(c));
+        }
+        return c == EOF ? 0 : c;
+    }
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        for (std::streamsize i = 0; i < n; i++) {
+            overflow(s[i]);
+        }
+        return n;
+    }
+};
+
+//odtwarza playliste, zwracajac czas i liczbe odtworzen kazdego wiersza
+double play_counted(DiskPlaylist& playlist, LineCounter& counter) {
+    counter.counts.clear();
+    std::streambuf* old_buffer = std::cout.rdbuf(&counter);
+    auto start = std::chrono::steady_clock::now();
+    playlist.play();
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+    std::cout.rdbuf(old_buffer);
+    return elapsed.count();
+}
+
+//czy kazda piosenka zostala odtworzona ENTRIES / SONGS razy
+bool each_once(const LineCounter& counter) {
+    size_t songs = 0;
+    for (const auto& line : counter.counts) {
+        if (line.first.compare(0, 5, "Song ") == 0) {
+            if (line.second != ENTRIES / SONGS) {
+                return false;
+            }
+            songs++;
+        }
+    }
+    return songs == SONGS;
+}
+
+int main() {
+    bool ok = true;
+    auto registry = std::make_shared<ItemRegistry>();
+    auto playlist = Player::createDiskPlaylist("disk", "/tmp", registry,
+                                               CACHE_BYTES);
+    std::vector<std::shared_ptr<Play>> songs;
+    for (size_t i = 0; i < SONGS; i++) {
+        std::string descriptor = "audio|artist:Artist|title:Song " +
+                                 std::to_string(i) + "|la la la";
+        songs.push_back(Player::openFile(File(descriptor.c_str())));
+    }
+    for (size_t i = 0; i < ENTRIES; i++) {
+        playlist->add(songs[i % SONGS]);
+    }
+    size_t cache_pages = CACHE_BYTES / DiskPlaylist::PAGE_BYTES;
+
+    LineCounter counter;
+    double sequential = play_counted(*playlist, counter);
+    ok &= check(each_once(counter), "sequence plays every entry once");
+
+    playlist->setMode(std::make_shared<ShuffleMode>(7));
+    double shuffled = play_counted(*playlist, counter);
+    ok &= check(each_once(counter), "shuffle plays every entry once");
+    std::cout << "sequence: " << sequential << " s, shuffle: " << shuffled
+              << " s" << std::endl;
+    ok &= check(shuffled < 3 * sequential + 0.5, "shuffle reads by pages");
+    ok &= check(playlist->resident_pages() <= cache_pages,
+                "shuffle keeps the page cache bound");
+
+    bool rejected = false;
+    try {
+        playlist->setMode(std::make_shared<SpreadMode>(7));
+    } catch (WrongMode&) {
+        rejected = true;
+    }
+    ok &= check(rejected, "SpreadMode rejected");
+
+    playlist->setMode(std::make_shared<OddEvenMode>());
+    play_counted(*playlist, counter);
+    ok &= check(each_once(counter), "odd-even plays every entry once");
+    return ok ? 0 : 1;
+}
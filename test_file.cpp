@@ -0,0 +1,76 @@
+//Sprawdza, ze niepoprawny opis pliku rzuca wyjatek tam, gdzie obiecuje
+//to File: nie w konstruktorze, ale przy pierwszym dostepie do metadanych
+//(a wiec w openFile), za kazdym razem i takze z pamiecia podreczna,
+//ktora takiego pliku nie zapamietuje. Poprawny plik dostaje caly tekst.
+//Kompilacja: g++ -std=c++17 -O2 -pthread test_file.cpp -o test_file
+#include "lib_playlist.h"
+
+bool check(bool condition, const std::string& what) {
+    std::cout << (condition ? "ok: " : "FAILED: ") << what << std::endl;
+    return condition;
+}
+
+//czy wywolanie rzuca wyjatek podanego typu
+template <typename Error, typename Call>
+bool throws(const Call& call) {
+    try {
+        call();
+    } catch (Error&) {
+        return true;
+    } catch (...) {
+        return false;
+    }
+    return false;
+}
+
+//opis i wyjatek, ktory ma rzucic przy pierwszym dostepie do metadanych
+//albo dopiero przy tworzeniu utworu
+template <typename Error>
+bool malformed(const char* descriptor, bool in_metadata) {
+    bool ok = true;
+    std::string name = descriptor;
+    bool constructed = true;
+    try {
+        File file(descriptor);
+        if (in_metadata) {
+            ok &= check(throws<Error>([&] { file.get_metadata(); }),
+                        name + ": metadata access throws");
+            ok &= check(throws<Error>([&] { file.get_lyrics(); }),
+                        name + ": second access throws again");
+        }
+    } catch (...) {
+        constructed = false;
+    }
+    ok &= check(constructed, name + ": constructor does not throw");
+    ok &= check(throws<Error>([&] { Player::openFile(File(descriptor)); }),
+                name + ": openFile throws");
+    return ok;
+}
+
+bool all_malformed() {
+    bool ok = true;
+    ok &= malformed<CorruptFile>("no separators", true);
+    ok &= malformed<WrongType>("text|artist:A|title:B|words", true);
+    ok &= malformed<WrongLyrics>("audio|artist:A|title:B|bad ~ lyrics", true);
+    ok &= malformed<NoNecessaryData>("audio|artist:A|words", false);
+    ok &= malformed<WrongYear>("video|title:T|year:19x2|words", false);
+    return ok;
+}
+
+int main() {
+    bool ok = all_malformed();
+
+    File file("audio|artist:A|title:B|I see trees of green, red roses too...");
+    ok &= check(file.get_lyrics() == "I see trees of green, red roses too..." &&
+                file.get_metadata().at("title") == "B", "lyrics and metadata");
+
+    Player::setCache(std::make_shared<PlayCache>(16));
+    ok &= all_malformed();
+    const char* valid = "video|title:Cabaret|year:1972|Qvfcynlvat Pnonerg";
+    auto first = Player::openFile(File(valid));
+    auto second = Player::openFile(File(valid));
+    ok &= check(first != nullptr && first == second, "valid file cached");
+    ok &= check(Player::getCache()->size() == 1, "malformed files not cached");
+    Player::setCache(nullptr);
+    return ok ? 0 : 1;
+}
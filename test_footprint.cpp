@@ -0,0 +1,117 @@
+//Porownuje MemoryFootprint z pamiecia faktycznie przydzielona przez new
+//przy budowie hierarchii: playlisty z piosenkami, podplaylisty zawartej
+//w niej kilka razy, klonu i planu. Suma ma sie zgadzac z przydzielonymi
+//bajtami (bez narzutu alokatora) z dokladnoscia do TOLERANCE, a klon
+//i wspoldzielona podplaylista maja zwiekszac sume tylko o to, co
+//faktycznie dla nich przydzielono.
+//Kompilacja: g++ -std=c++17 -O2 -pthread test_footprint.cpp -o test_footprint
+#include <cstdlib>
+#include <new>
+
+//zajete bajty; przed kazdym blokiem jest zapisany jego rozmiar
+static size_t live_bytes = 0;
+static const size_t HEADER = 16;
+
+[[gnu::noinline]] void* operator new(size_t size) {
+    char* p = static_cast<char*>(std::malloc(size + HEADER));
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    *reinterpret_cast<size_t*>(p) = size;
+    live_bytes += size;
+    return p + HEADER;
+}
+[[gnu::noinline]] void operator delete(void* p) noexcept {
+    if (p == nullptr) {
+        return;
+    }
+    char* block = static_cast<char*>(p) - HEADER;
+    live_bytes -= *reinterpret_cast<size_t*>(block);
+    std::free(block);
+}
+[[gnu::noinline]] void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+#include "lib_playlist.h"
+
+const size_t SONGS = 300;
+const size_t ITEMS = 3000;
+//dopuszczalna roznica wzgledem przydzielonych bajtow
+const double TOLERANCE = 0.05;
+
+bool check(bool condition, const char* what) {
+    std::cout << (condition ? "ok: " : "FAILED: ") << what << std::endl;
+    return condition;
+}
+
+//czy oszacowanie miesci sie w tolerancji wzgledem zmierzonych bajtow
+bool close_to(size_t estimate, size_t measured) {
+    double difference = static_cast<double>(estimate) -
+                        static_cast<double>(measured);
+    std::cout << "  footprint " << estimate << " B, allocated " << measured
+              << " B" << std::endl;
+    return std::abs(difference) <= TOLERANCE * static_cast<double>(measured);
+}
+
+int main() {
+    bool ok = true;
+    //pierwsze otwarcie kompiluje statyczne wyrazenia regularne
+    Player::openFile(File("audio|artist:a|title:b|c"));
+    std::vector<std::shared_ptr<Play>> songs;
+    songs.reserve(SONGS);
+
+    size_t start = live_bytes;
+    for (size_t i = 0; i < SONGS; i++) {
+        std::string descriptor = "audio|artist:Artist number " +
+                                 std::to_string(i) + "|title:Song " +
+                                 std::to_string(i) + "|" +
+                                 std::string(40 + i % 50, 'l');
+        songs.push_back(Player::openFile(File(descriptor.c_str())));
+    }
+    auto top = Player::createPlaylist("top");
+    for (size_t i = 0; i < ITEMS; i++) {
+        top->add(songs[i % SONGS]);
+    }
+    top->compile();
+    ok &= check(close_to(top->footprint().total(), live_bytes - start),
+                "playlist with songs and a plan");
+
+    size_t before_shared = live_bytes;
+    auto shared = Player::createPlaylist("shared");
+    for (size_t i = 0; i < ITEMS / 10; i++) {
+        shared->add(songs[(i * 7) % SONGS]);
+    }
+    size_t shared_bytes = live_bytes - before_shared;
+    //piosenki byly przydzielone wczesniej, wiec sa tu pomijane
+    MemoryFootprint own = shared->footprint();
+    ok &= check(close_to(own.total() - own.items - own.strings, shared_bytes),
+                "sub-playlist alone");
+
+    //podplaylista zawarta trzy razy jest liczona raz
+    MemoryFootprint alone = top->footprint();
+    size_t before_add = live_bytes;
+    for (size_t i = 0; i < 3; i++) {
+        top->add(shared, i * 500);
+    }
+    top->compile();
+    size_t added = live_bytes - before_add;
+    MemoryFootprint with_shared = top->footprint();
+    ok &= check(close_to(with_shared.total() - alone.total(),
+                         shared_bytes + added),
+                "repeated sub-playlist counted once");
+    ok &= check(with_shared.shared > 0, "shared objects reported");
+
+    //klon wspoldzieli kawalki, wiec kosztuje tylko swoje tablice
+    size_t before_clone = live_bytes;
+    auto copy = top->clone("copy");
+    auto holder = Player::createPlaylist("holder");
+    holder->add(top);
+    holder->add(copy);
+    size_t cloned = live_bytes - before_clone;
+    ok &= check(close_to(holder->footprint().total() - with_shared.total(),
+                         cloned), "clone shares its chunks");
+    ok &= check(close_to(holder->footprint().total(), live_bytes - start),
+                "whole hierarchy");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,56 @@
+//Sprawdza, ze historia zmian nie przedluza zycia usunietych podplaylist:
+//dwie playlisty, ktore usunely siebie nawzajem, sa zwalniane, a cofniecie
+//usuniecia zwolnionej podplaylisty konczy sie UndoError i czysci historie.
+//Kompilacja: g++ -std=c++17 -O2 -pthread test_history.cpp -o test_history
+#include "lib_playlist.h"
+
+bool check(bool condition, const char* what) {
+    std::cout << (condition ? "ok: " : "FAILED: ") << what << std::endl;
+    return condition;
+}
+
+int main() {
+    bool ok = true;
+    auto song = Player::openFile(File("audio|artist:Louis Armstrong|"
+                                      "title:What a Wonderful World|"
+                                      "I see trees of green, red roses too..."));
+    std::weak_ptr<Playlist> weak_a;
+    std::weak_ptr<Playlist> weak_b;
+    {
+        auto a = Player::createPlaylist("a");
+        auto b = Player::createPlaylist("b");
+        a->setHistoryLimit(10);
+        b->setHistoryLimit(10);
+        a->add(b);
+        a->remove(0);
+        b->add(a);
+        b->remove(0);
+        weak_a = a;
+        weak_b = b;
+    }
+    ok &= check(weak_a.expired() && weak_b.expired(),
+                "playlists removing each other are freed");
+
+    auto top = Player::createPlaylist("top");
+    top->setHistoryLimit(10);
+    top->add(song);
+    {
+        auto sub = Player::createPlaylist("sub");
+        sub->add(song);
+        top->add(sub);
+        top->remove(1);
+        ok &= check(top->undo() && top->stats().playlists == 2,
+                    "undo restores a live sub-playlist");
+        top->remove(1);
+    }
+    bool failed = false;
+    try {
+        top->undo();
+    } catch (UndoError&) {
+        failed = true;
+    }
+    ok &= check(failed, "undo of a freed sub-playlist throws");
+    ok &= check(!top->undo() && top->stats().playlists == 1 &&
+                top->stats().songs == 1, "history is cleared after UndoError");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+//Sprawdza MutationLog: nieudany zapis zmiany wychodzi z metody
+//playlisty jako DiskError, ale zmiana zostaje, a pozostali obserwatorzy
+//ja dostaja; compact() rownolegle ze zmianami z innych watkow nie
+//zapisuje zadnej zmiany dwa razy.
+//Kompilacja: g++ -std=c++17 -O2 -pthread test_log.cpp -o test_log
+#include "lib_playlist.h"
+#include <sstream>
+
+const size_t EDITORS = 2;
+const size_t EDITS = 2000;
+
+bool check(bool condition, const char* what) {
+    std::cout << (condition ? "ok: " : "FAILED: ") << what << std::endl;
+    return condition;
+}
+
+//liczy powiadomienia o wstawieniach
+class InsertCounter : public PlaylistObserver {
+public:
+    size_t inserted_count = 0;
+    void inserted(Playlist&, size_t, Playlist::Items::const_iterator,
+                  size_t count) override {
+        inserted_count += count;
+    }
+    void erased(Playlist&, size_t, size_t) override {}
+    void moved(Playlist&, size_t, size_t, size_t) override {}
+    void reordered(Playlist&, const std::vector<size_t>&) override {}
+    void mode_changed(Playlist&, const std::shared_ptr<Mode>&) override {}
+};
+
+//zwraca to, co wypisalo play
+std::string played(Playlist& playlist) {
+    std::ostringstream out;
+    std::streambuf* old_buffer = std::cout.rdbuf(out.rdbuf());
+    playlist.play();
+    std::cout.rdbuf(old_buffer);
+    return out.str();
+}
+
+int main() {
+    bool ok = true;
+    auto song = Player::openFile(File("audio|artist:A|title:Song|la la"));
+    {
+        auto playlist = Player::createPlaylist("full");
+        InsertCounter counter;
+        //kazdy zapis do /dev/full konczy sie bledem
+        MutationLog log("/dev/full");
+        bool track_failed = false;
+        try {
+            log.track(playlist);
+        } catch (DiskError&) {
+            track_failed = true;
+        }
+        playlist->addObserver(&counter);
+        bool add_failed = false;
+        try {
+            playlist->add(song);
+        } catch (DiskError&) {
+            add_failed = true;
+        }
+        ok &= check(track_failed && log.has_failed(), "failed track reported");
+        ok &= check(add_failed, "failed change reported to the caller");
+        ok &= check(playlist->stats().songs == 1, "change stays in memory");
+        ok &= check(counter.inserted_count == 1, "other observers notified");
+        playlist->removeObserver(&counter);
+    }
+
+    char path[] = "/tmp/test_log_XXXXXX";
+    int file = ::mkstemp(path);
+    ::close(file);
+    std::vector<std::string> expected;
+    {
+        MutationLog log(path);
+        std::vector<std::shared_ptr<Playlist>> roots;
+        for (size_t i = 0; i < EDITORS; i++) {
+            roots.push_back(Player::createPlaylist("root"));
+            log.track(roots.back());
+        }
+        std::vector<std::thread> editors;
+        std::atomic<size_t> finished {0};
+        for (size_t i = 0; i < EDITORS; i++) {
+            editors.emplace_back([&log, &song, &finished, root = roots[i]] {
+                auto inner = Player::createPlaylist("inner");
+                {
+                    auto guard = log.edit_lock();
+                    root->add(inner);
+                }
+                for (size_t edit = 0; edit < EDITS; edit++) {
+                    auto guard = log.edit_lock();
+                    if (edit % 3 == 2) {
+                        inner->remove();
+                    } else {
+                        inner->add(song);
+                    }
+                }
+                finished++;
+            });
+        }
+        size_t compactions = 0;
+        do {
+            log.compact();
+            compactions++;
+        } while (finished < EDITORS);
+        for (auto& editor : editors) {
+            editor.join();
+        }
+        for (auto& root : roots) {
+            expected.push_back(played(*root));
+        }
+        std::cout << compactions << " compactions" << std::endl;
+    }
+    MutationLog reopened(path);
+    bool same = reopened.playlist_count() >= EDITORS;
+    for (size_t i = 0; same && i < EDITORS; i++) {
+        same = played(*reopened.get(static_cast<uint32_t>(i))) == expected[i];
+    }
+    ok &= check(same, "compact during edits replays each change once");
+    std::remove(path);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+//Sprawdza, ze sposob odtwarzania napisany tylko z play_with_mode dostaje
+//w play() prawdziwe elementy playlisty, takze gdy jest podplaylista
+//w playliscie z wbudowanym sposobem, a compile zachowuje jego kolejnosc.
+//Kompilacja: g++ -std=c++17 -O2 -pthread test_modes.cpp -o test_modes
+#include "lib_playlist.h"
+#include <sstream>
+
+bool check(bool condition, const char* what) {
+    std::cout << (condition ? "ok: " : "FAILED: ") << what << std::endl;
+    return condition;
+}
+
+//odtwarza od konca i zapamietuje elementy, ktore dostal
+class ReverseMode : public Mode {
+public:
+    std::vector<PlaylistInterface*> seen;
+    void play_with_mode
+        (std::list<std::shared_ptr<PlaylistInterface>>& list) override {
+        seen.clear();
+        for (auto it = list.rbegin(); it != list.rend(); it++) {
+            seen.push_back(it->get());
+            (*it)->play();
+        }
+    }
+};
+
+//zwraca to, co wypisalo play
+std::string played(PlaylistInterface& playlist) {
+    std::ostringstream out;
+    std::streambuf* old_buffer = std::cout.rdbuf(out.rdbuf());
+    playlist.play();
+    std::cout.rdbuf(old_buffer);
+    return out.str();
+}
+
+int main() {
+    bool ok = true;
+    auto first = Player::openFile(File("audio|artist:A|title:First|one"));
+    auto second = Player::openFile(File("audio|artist:B|title:Second|two"));
+    auto inner = Player::createPlaylist("inner");
+    inner->add(std::make_shared<Playlist>("empty"));
+    auto reversed = Player::createPlaylist("reversed");
+    reversed->add(first);
+    reversed->add(second);
+    reversed->add(inner);
+    auto mode = std::make_shared<ReverseMode>();
+    reversed->setMode(mode);
+
+    std::string alone = played(*reversed);
+    std::vector<PlaylistInterface*> expected
+            {inner.get(), second.get(), first.get()};
+    ok &= check(mode->seen == expected, "custom mode gets the real items");
+    ok &= check(dynamic_cast<Playlist*>(mode->seen[0]) == inner.get(),
+                "sub-playlist keeps its type");
+    ok &= check(alone == "Playlist [reversed]\nPlaylist [inner]\n"
+                         "Playlist [empty]\nSong [B Second]: two\n"
+                         "Song [A First]: one\n", "custom mode order");
+
+    auto top = Player::createPlaylist("top");
+    top->add(reversed);
+    mode->seen.clear();
+    std::string nested = played(*top);
+    ok &= check(mode->seen == expected, "nested custom mode gets the real items");
+    ok &= check(nested == "Playlist [top]\n" + alone, "nested order");
+
+    std::ostringstream compiled;
+    auto plan = top->compile();
+    std::streambuf* old_buffer = std::cout.rdbuf(compiled.rdbuf());
+    plan->play();
+    std::cout.rdbuf(old_buffer);
+    ok &= check(compiled.str() == nested, "compile keeps the custom order");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+//Sprawdza kopie playlisty w drugim procesie: ramki ChangeFeed ida przez
+//socketpair do potomka, ktory stosuje je ChangeApplier i odsyla wynik
+//play(). Zmiany skladaja sie w ramkach, kilka ramek przychodzi w jednym
+//odczycie, a ramka urwana w polowie czeka na reszte albo, gdy strumien
+//sie konczy, jest odrzucana.
+//Kompilacja: g++ -std=c++17 -O2 -pthread test_replica.cpp -o test_replica
+#include "lib_playlist.h"
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+bool check(bool condition, const char* what) {
+    std::cout << (condition ? "ok: " : "FAILED: ") << what << std::endl;
+    return condition;
+}
+
+//zwraca to, co wypisalo play
+std::string played(PlaylistInterface& playlist) {
+    std::ostringstream out;
+    std::streambuf* old_buffer = std::cout.rdbuf(out.rdbuf());
+    playlist.play();
+    std::cout.rdbuf(old_buffer);
+    return out.str();
+}
+
+void write_all(int fd, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t written = ::write(fd, data.data() + done, data.size() - done);
+        if (written <= 0) {
+            throw DiskError();
+        }
+        done += static_cast<size_t>(written);
+    }
+}
+
+//wiadomosc z dlugoscia na poczatku, w obie strony
+void send_message(int fd, const std::string& message) {
+    uint32_t length = static_cast<uint32_t>(message.size());
+    write_all(fd, std::string(reinterpret_cast<const char*>(&length),
+                              sizeof(length)) + message);
+}
+bool read_exact(int fd, char* data, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t got = ::read(fd, data + done, size - done);
+        if (got <= 0) {
+            return false;
+        }
+        done += static_cast<size_t>(got);
+    }
+    return true;
+}
+std::string receive_message(int fd) {
+    uint32_t length = 0;
+    if (!read_exact(fd, reinterpret_cast<char*>(&length), sizeof(length))) {
+        throw DiskError();
+    }
+    std::string message(length, '\0');
+    if (!read_exact(fd, &message[0], length)) {
+        throw DiskError();
+    }
+    return message;
+}
+
+//Potomek: na kazda wiadomosc z ramkami stosuje je wszystkie, a ramke
+//urwana na koncu zostawia na poczatek nastepnej wiadomosci. Odsyla
+//liczbe ramek zastosowanych w tej wiadomosci i wynik play() kopii.
+//Pusta wiadomosc konczy podawanie ramek wiadomosciami; dalej ramki sa
+//czytane wprost z gniazda przez apply(fd) az do jego zamkniecia
+int replica(int fd) {
+    ChangeApplier applier;
+    std::string buffered;
+    while (true) {
+        std::string message = receive_message(fd);
+        if (message.empty()) {
+            break;
+        }
+        buffered += message;
+        size_t frames = 0;
+        size_t used;
+        while ((used = applier.apply(buffered.data(), buffered.size())) > 0) {
+            buffered.erase(0, used);
+            frames++;
+        }
+        send_message(fd, std::to_string(frames) + "\n" +
+                         played(*applier.get()));
+    }
+    std::string result = "closed";
+    try {
+        while (applier.apply(fd)) {
+        }
+    } catch (DiskError&) {
+        result = "truncated";
+    }
+    send_message(fd, result + "\n" + played(*applier.get()));
+    return 0;
+}
+
+//wysyla dane do kopii i sprawdza liczbe zastosowanych ramek i play()
+bool matches(int fd, const std::string& data, size_t frames,
+             Playlist& source) {
+    send_message(fd, data);
+    std::string answer = receive_message(fd);
+    return answer == std::to_string(frames) + "\n" + played(source);
+}
+
+int main() {
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        return 1;
+    }
+    std::cout.flush();
+    pid_t child = ::fork();
+    if (child == 0) {
+        ::close(fds[0]);
+        ::_exit(replica(fds[1]));
+    }
+    ::close(fds[1]);
+    int fd = fds[0];
+    bool ok = true;
+
+    auto armstrong = Player::openFile(File("audio|artist:Louis Armstrong|"
+                                           "title:What a Wonderful World|"
+                                           "I see trees of green, red roses too..."));
+    auto queen = Player::openFile(File("audio|artist:Queen|"
+                                       "title:Bohemian Rhapsody|Is this the real life?"));
+    auto cabaret = Player::openFile(File("video|title:Cabaret|year:1972|"
+                                         "Qvfcynlvat Pnonerg"));
+    auto source = Player::createPlaylist("source");
+    auto inner = Player::createPlaylist("inner");
+    source->add(armstrong);
+    source->add(inner);
+    inner->add(queen);
+    ChangeFeed feed(source);
+    ok &= check(matches(fd, feed.flush(), 1, *source), "initial frame");
+
+    //sasiednie wstawienia, usuniecie czesci z nich i kilka zmian
+    //sposobu odtwarzania ida jako pojedyncze rekordy jednej ramki
+    source->add(queen);
+    source->add(cabaret);
+    source->add(armstrong, 0);
+    source->remove(3);
+    inner->setMode(std::make_shared<ShuffleMode>(3));
+    inner->setMode(std::make_shared<OddEvenMode>());
+    inner->add(cabaret);
+    inner->add(armstrong);
+    ok &= check(matches(fd, feed.flush(), 1, *source), "coalesced edits");
+
+    //dwie ramki w jednym odczycie
+    source->reorder({3, 2, 1, 0});
+    std::string both = feed.flush();
+    source->splice(0, *inner, 0, 2);
+    inner->undo();
+    source->setMode(std::make_shared<ShuffleMode>(11));
+    both += feed.flush();
+    ok &= check(matches(fd, both, 2, *source), "two frames in one read");
+
+    //ramka urwana w polowie jest stosowana dopiero z reszta
+    std::string previous = played(*source);
+    auto extra = Player::createPlaylist("extra");
+    extra->add(cabaret);
+    source->add(extra, 1);
+    source->remove(0);
+    std::string frame = feed.flush();
+    std::string half = frame.substr(0, frame.size() / 2);
+    send_message(fd, half);
+    std::string answer = receive_message(fd);
+    ok &= check(answer == "0\n" + previous, "partial frame waits");
+    ok &= check(matches(fd, frame.substr(half.size()), 1, *source),
+                "rest of the frame applied");
+
+    //dalej ramki wprost z gniazda; strumien urwany w polowie ramki
+    send_message(fd, "");
+    extra->add(queen);
+    feed.flush(fd);
+    std::string applied = played(*source);
+    source->add(queen);
+    frame = feed.flush();
+    write_all(fd, frame.substr(0, frame.size() - 3));
+    ::shutdown(fd, SHUT_WR);
+    answer = receive_message(fd);
+    ok &= check(answer == "truncated\n" + applied, "truncated stream");
+
+    int status = 0;
+    ::waitpid(child, &status, 0);
+    ok &= check(WIFEXITED(status) && WEXITSTATUS(status) == 0, "replica exit");
+    return ok ? 0 : 1;
+}